@@ -0,0 +1,75 @@
+#include "Builtins.hpp"
+
+#include "Object.hpp"
+#include "Resolver.hpp"
+#include "VM.hpp"
+#include <array>
+#include <chrono>
+#include <random>
+#include <string_view>
+
+Value builtin_clock(std::span<Value> /* args */) {
+    auto time_point = std::chrono::high_resolution_clock::now();
+    using seconds = std::chrono::duration<double>;
+    return seconds(time_point.time_since_epoch()).count();
+}
+
+Value builtin_typename(std::span<Value> args) {
+    // Statically allocated, so that the builtins don't need the Heap.
+    static const std::array<String, 6> names{
+        "Nil", "Boolean", "Number", "String", "Function", "BuiltinFunction"
+    };
+    std::string_view name{ type_name(args[0]) };
+    for (const String& candidate : names) {
+        if (candidate == name) {
+            return &candidate;
+        }
+    }
+    assert(false && "Missing type name");
+    return {};
+}
+
+Value builtin_rand(std::span<Value> /* args */) {
+    thread_local std::mt19937 engine{};
+    thread_local std::uniform_real_distribution<double> dist{};
+    return dist(engine);
+}
+
+Value builtin_randint(std::span<Value> args) {
+    thread_local std::mt19937 engine{};
+    if (!args[0].is<Number>() || !args[1].is<Number>()) {
+        return {};
+    }
+    const auto min = static_cast<long long>(args[0].as<Number>());
+    const auto max = static_cast<long long>(args[1].as<Number>());
+    std::uniform_int_distribution<long long int> dist{ min, max };
+    return static_cast<Number>(dist(engine));
+}
+
+
+
+
+
+void setup_builtins(VM& vm, Resolver& resolver) {
+
+    auto define_builtin =
+        [&vm, &resolver](
+            const char* name, native_function_t fun, size_t arity
+        ) {
+
+        std::string name_string{ name };
+
+        auto slot = resolver.declare(name_string);
+        assert(slot && "This should definetly not happen.");
+        resolver.define(name_string);
+
+        vm.define_global(*slot, vm.heap().make_native(name, arity, fun));
+    };
+
+
+    define_builtin("clock", builtin_clock, 0);
+    define_builtin("typename", builtin_typename, 1);
+    define_builtin("rand", builtin_rand, 0);
+    define_builtin("randint", builtin_randint, 2);
+
+}
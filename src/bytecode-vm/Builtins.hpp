@@ -0,0 +1,16 @@
+#pragma once
+#include <span>
+#include "Value.hpp"
+
+
+Value builtin_clock(std::span<Value> args);
+Value builtin_typename(std::span<Value> args);
+Value builtin_rand(std::span<Value> args);
+Value builtin_randint(std::span<Value> args);
+
+
+class VM;
+class Resolver;
+
+// Call before the first pass, when the Resolver is in the global scope
+void setup_builtins(VM& vm, Resolver& resolver);
@@ -0,0 +1,407 @@
+#include "BytecodeCache.hpp"
+
+#include "Object.hpp"
+#include "SourceManager.hpp"
+#include "Value.hpp"
+#include "Verifier.hpp"
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#define LOX_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path& path) {
+    MappedFile file;
+#ifdef LOX_HAS_MMAP
+    int fd{ ::open(path.c_str(), O_RDONLY) };
+    if (fd < 0) {
+        return {};
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return {};
+    }
+    void* data{ ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0) };
+    // The mapping stays valid after closing the descriptor.
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return {};
+    }
+    file.data_ = static_cast<const Byte*>(data);
+    file.size_ = size_t(info.st_size);
+#else
+    auto text = SourceManager::read_file(path);
+    if (!text) {
+        return {};
+    }
+    file.buffer_.assign(text->begin(), text->end());
+    file.data_ = file.buffer_.data();
+    file.size_ = file.buffer_.size();
+#endif
+    return file;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    data_{ std::exchange(other.data_, nullptr) },
+    size_{ std::exchange(other.size_, 0) },
+    buffer_{ std::move(other.buffer_) }
+{}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        MappedFile old{ std::move(*this) };
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        buffer_ = std::move(other.buffer_);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+#ifdef LOX_HAS_MMAP
+    if (data_) {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast): munmap takes void*
+        ::munmap(const_cast<Byte*>(data_), size_);
+    }
+#endif
+}
+
+
+
+
+std::filesystem::path bytecode_cache_path(const std::filesystem::path& source_path) {
+    std::filesystem::path path{ source_path };
+    return path.replace_extension(".loxc");
+}
+
+
+// FNV-1a, 64-bit.
+uint64_t source_hash(std::string_view text) noexcept {
+    uint64_t hash{ 0xcbf2'9ce4'8422'2325 };
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x0000'0100'0000'01b3;
+    }
+    return hash;
+}
+
+
+
+
+namespace {
+
+constexpr uint32_t cache_magic{ 0x43'58'4f'4c }; // "LOXC" in little-endian
+
+enum class ConstantTag : uint8_t {
+    number, string, function
+};
+
+
+class CacheWriter {
+private:
+    std::vector<Byte> bytes_;
+
+public:
+    template<typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto* first = reinterpret_cast<const Byte*>(&value);
+        bytes_.insert(bytes_.end(), first, first + sizeof(T));
+    }
+
+    void write_bytes(std::span<const Byte> bytes) {
+        write(static_cast<uint32_t>(bytes.size()));
+        bytes_.insert(bytes_.end(), bytes.begin(), bytes.end());
+    }
+
+    void write_string(std::string_view string) {
+        write_bytes({ reinterpret_cast<const Byte*>(string.data()), string.size() });
+    }
+
+    // Fails on the values that cannot be constants.
+    bool write_chunk(const Chunk& chunk) {
+        write_bytes(chunk.bytes());
+        const Constants& constants{ chunk.constants() };
+        write(static_cast<uint32_t>(constants.size()));
+        for (size_t i{ 0 }; i < constants.size(); ++i) {
+            const Value& constant{ constants[i] };
+            if (constant.is<Number>()) {
+                write(ConstantTag::number);
+                write(constant.as<Number>());
+            } else if (constant.is<const String*>()) {
+                const String& string{ *constant.as<const String*>() };
+                write(ConstantTag::string);
+                write_string({ string.data(), string.size() });
+            } else if (constant.is<const Function*>()) {
+                const Function& function{ *constant.as<const Function*>() };
+                write(ConstantTag::function);
+                write_string(function.name);
+                write(static_cast<uint32_t>(function.arity));
+                write(static_cast<uint32_t>(function.num_upvalues));
+                if (!write_chunk(function.chunk)) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        write_lines(chunk.lines());
+        return true;
+    }
+
+    void write_lines(const LineTable& lines) {
+        write(static_cast<uint32_t>(lines.files().size()));
+        for (FileTable::Id file : lines.files()) {
+            write_string(
+                file == FileTable::no_file ? std::string{} : FileTable::instance().path(file).string()
+            );
+        }
+        write(static_cast<uint32_t>(lines.runs().size()));
+        for (const LineTable::Run& run : lines.runs()) {
+            write(run);
+        }
+    }
+
+    void append(const CacheWriter& other) {
+        bytes_.insert(bytes_.end(), other.bytes_.begin(), other.bytes_.end());
+    }
+
+    const std::vector<Byte>& bytes() const noexcept { return bytes_; }
+};
+
+
+// Reads from the mapped file. After the first out-of-bounds read
+// it is failed(), and all of the following reads return zeroes.
+class CacheReader {
+private:
+    std::span<const Byte> bytes_;
+    size_t pos_{ 0 };
+    bool failed_{ false };
+
+public:
+    explicit CacheReader(std::span<const Byte> bytes) : bytes_{ bytes } {}
+
+    template<typename T>
+    T read() noexcept {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value{};
+        if (!fits(sizeof(T))) {
+            return value;
+        }
+        std::memcpy(&value, bytes_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    std::span<const Byte> read_bytes() noexcept {
+        auto size = read<uint32_t>();
+        if (!fits(size)) {
+            return {};
+        }
+        std::span<const Byte> bytes{ bytes_.subspan(pos_, size) };
+        pos_ += size;
+        return bytes;
+    }
+
+    std::string_view read_string() noexcept {
+        auto bytes = read_bytes();
+        return { reinterpret_cast<const char*>(bytes.data()), bytes.size() };
+    }
+
+    // The 'function' the chunk belongs to, null for the top-level code.
+    bool read_chunk(Chunk& chunk, Heap& heap, const Function* function, size_t num_globals) {
+        chunk.map_bytes(read_bytes());
+        auto num_constants = read<uint32_t>();
+        for (uint32_t i{ 0 }; i < num_constants && !failed_; ++i) {
+            Value constant{};
+            switch (read<ConstantTag>()) {
+                case ConstantTag::number:
+                    constant = read<Number>();
+                    break;
+                case ConstantTag::string: {
+                        std::string_view string{ read_string() };
+                        constant = heap.intern_string(String{ string.begin(), string.end() });
+                    }
+                    break;
+                case ConstantTag::function: {
+                        std::string_view name{ read_string() };
+                        Function* function{ heap.make_function(std::string{ name }, read<uint32_t>()) };
+                        function->num_upvalues = read<uint32_t>();
+                        if (!read_chunk(function->chunk, heap, function, num_globals)) {
+                            return false;
+                        }
+                        constant = static_cast<const Function*>(function);
+                    }
+                    break;
+                default:
+                    return false;
+            }
+            // The constants were already deduplicated when writing.
+            if (chunk.add_constant(constant) != i) {
+                return false;
+            }
+        }
+        // Once the constants are there. The max_stack() is not stored, it follows from the code.
+        auto max_stack = verify_chunk(chunk, function, num_globals);
+        if (!max_stack) {
+            return false;
+        }
+        chunk.set_max_stack(*max_stack);
+        return read_lines(chunk.lines());
+    }
+
+    bool read_lines(LineTable& lines) {
+        auto num_files = read<uint32_t>();
+        for (uint32_t i{ 0 }; i < num_files && !failed_; ++i) {
+            std::string_view file{ read_string() };
+            lines.add_file(
+                file.empty() ? FileTable::no_file : FileTable::instance().add(file)
+            );
+        }
+        auto num_runs = read<uint32_t>();
+        for (uint32_t i{ 0 }; i < num_runs && !failed_; ++i) {
+            auto run = read<LineTable::Run>();
+            if (run.file_id >= num_files) {
+                return false;
+            }
+            lines.add_run(run);
+        }
+        return !failed_;
+    }
+
+    // Everything not read yet.
+    std::span<const Byte> rest() const noexcept { return bytes_.subspan(pos_); }
+
+    bool failed() const noexcept { return failed_; }
+    bool at_end() const noexcept { return pos_ == bytes_.size(); }
+
+private:
+    bool fits(size_t size) noexcept {
+        if (failed_ || bytes_.size() - pos_ < size) {
+            failed_ = true;
+            return false;
+        }
+        return true;
+    }
+};
+
+
+// Of the payload, the chunk after the header.
+uint64_t payload_checksum(std::span<const Byte> bytes) noexcept {
+    return source_hash({ reinterpret_cast<const char*>(bytes.data()), bytes.size() });
+}
+
+
+std::optional<uint64_t> file_hash(const std::filesystem::path& path) {
+    auto text = SourceManager::read_file(path);
+    if (!text) {
+        return {};
+    }
+    return source_hash(text.value());
+}
+
+} // namespace
+
+
+
+
+std::optional<CachedProgram> load_bytecode_cache(
+    const MappedFile& file, std::string_view source,
+    size_t num_builtins, int opt_level, Heap& heap)
+{
+    CacheReader reader{ file.bytes() };
+
+    if (reader.read<uint32_t>() != cache_magic ||
+        reader.read<uint32_t>() != bytecode_cache_version ||
+        reader.read<uint64_t>() != source_hash(source) ||
+        reader.read<uint32_t>() != num_builtins ||
+        reader.read<uint32_t>() != uint32_t(opt_level))
+    {
+        return {};
+    }
+
+    auto num_globals = reader.read<uint32_t>();
+
+    auto num_imports = reader.read<uint32_t>();
+    for (uint32_t i{ 0 }; i < num_imports; ++i) {
+        std::string_view path{ reader.read_string() };
+        auto hash = reader.read<uint64_t>();
+        if (reader.failed() || file_hash(path) != hash) {
+            return {};
+        }
+    }
+
+    // Catches the corruption that still reads as a well-formed chunk.
+    auto checksum = reader.read<uint64_t>();
+    if (reader.failed() || payload_checksum(reader.rest()) != checksum) {
+        return {};
+    }
+
+    CachedProgram program{ {}, num_globals };
+    if (!reader.read_chunk(program.chunk, heap, nullptr, num_globals) || !reader.at_end()) {
+        return {};
+    }
+    return program;
+}
+
+
+bool store_bytecode_cache(
+    const std::filesystem::path& cache_path, std::string_view source,
+    std::span<const std::filesystem::path> imports,
+    size_t num_builtins, int opt_level, size_t num_globals, const Chunk& chunk)
+{
+    CacheWriter writer;
+    writer.write(cache_magic);
+    writer.write(bytecode_cache_version);
+    writer.write(source_hash(source));
+    writer.write(static_cast<uint32_t>(num_builtins));
+    writer.write(static_cast<uint32_t>(opt_level));
+    writer.write(static_cast<uint32_t>(num_globals));
+
+    writer.write(static_cast<uint32_t>(imports.size()));
+    for (const auto& path : imports) {
+        auto hash = file_hash(path);
+        if (!hash) {
+            return false;
+        }
+        writer.write_string(path.string());
+        writer.write(hash.value());
+    }
+
+    CacheWriter payload;
+    if (!payload.write_chunk(chunk)) {
+        return false;
+    }
+    writer.write(payload_checksum(payload.bytes()));
+    writer.append(payload);
+
+    // Write to a temporary first, so that a concurrent run
+    // never maps a partially written cache.
+    std::filesystem::path temp_path{ cache_path };
+    temp_path += ".tmp";
+    {
+        std::ofstream fs{ temp_path, std::ios::binary | std::ios::trunc };
+        if (!fs) {
+            return false;
+        }
+        const auto& bytes = writer.bytes();
+        fs.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+        if (!fs) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, cache_path, ec);
+    return !ec;
+}
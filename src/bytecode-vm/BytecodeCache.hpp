@@ -0,0 +1,86 @@
+#pragma once
+#include "Chunk.hpp"
+#include "OpCode.hpp"
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+
+class Heap;
+
+
+// Compiled bytecode of a script, stored next to it as 'script.loxc',
+// so that the frontend and the codegen can be skipped on the next run.
+//
+// Layout, in the native byte order (the cache is not portable between machines):
+//
+//   header:   [u32 magic "LOXC"] [u32 version] [u64 source hash]
+//             [u32 number of builtins] [u32 optimization level] [u32 number of global slots]
+//             [u32 number of imports] then per import: [u32 size] [path] [u64 hash]
+//             [u64 checksum of the rest of the file]
+//   chunk:    [u32 size] [bytecode] [u32 number of constants] [constants...]
+//             [u32 number of files] then per file: [u32 size] [path, empty if none]
+//             [u32 number of runs] [line table runs...]
+//   constant: [u8 tag] followed by
+//             number:   [f64]
+//             string:   [u32 size] [characters]
+//             function: [u32 size] [name] [u32 arity] [u32 number of upvalues] [chunk]
+//
+// The top-level chunk follows the header. The bytecode is used in place,
+// straight from the mapped file, after checking each chunk with verify_chunk().
+// The cache is stale if the hash of the source or of any of the imported files
+// differs. Bump the version on any change to the layout or to the OP enum.
+inline constexpr uint32_t bytecode_cache_version{ 6 };
+
+
+// Read-only view of a whole file. Mapped into memory where possible,
+// otherwise read into a buffer.
+class MappedFile {
+private:
+    const Byte* data_{};
+    size_t size_{};
+    std::vector<Byte> buffer_;
+
+    MappedFile() = default;
+
+public:
+    static std::optional<MappedFile> open(const std::filesystem::path& path);
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    std::span<const Byte> bytes() const noexcept { return { data_, size_ }; }
+};
+
+
+struct CachedProgram {
+    Chunk chunk;
+    size_t num_globals;
+};
+
+
+// 'script.lox' -> 'script.loxc'
+std::filesystem::path bytecode_cache_path(const std::filesystem::path& source_path);
+
+uint64_t source_hash(std::string_view text) noexcept;
+
+
+// Returns nothing if the cache is stale, malformed, or any of the bytecode
+// fails the verify_chunk(). The functions are created in the 'heap'. Their bytecode
+// and the bytecode of the returned chunk refer to the 'file', it must outlive them.
+std::optional<CachedProgram> load_bytecode_cache(
+    const MappedFile& file, std::string_view source,
+    size_t num_builtins, int opt_level, Heap& heap
+);
+
+// The 'imports' must be canonical paths. Returns false if failed to write.
+bool store_bytecode_cache(
+    const std::filesystem::path& cache_path, std::string_view source,
+    std::span<const std::filesystem::path> imports,
+    size_t num_builtins, int opt_level, size_t num_globals, const Chunk& chunk
+);
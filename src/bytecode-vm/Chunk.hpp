@@ -1,37 +1,107 @@
 #pragma once
 #include "Constants.hpp"
+#include "LineTable.hpp"
 #include "Utils.hpp"
 #include "OpCode.hpp"
+#include <algorithm>
+#include <span>
 #include <vector>
 #include <utility>
+#include <cassert>
+#include <cstdint>
 
 
 class Chunk {
 private:
     Constants constants_;
     std::vector<Byte> bytes_;
+    // Set instead of the bytes_, when the bytecode
+    // is used in place from a mapped cache file.
+    std::span<const Byte> mapped_;
+    LineTable lines_;
+    size_t max_stack_{ 0 };
 
 public:
+    static constexpr size_t max_long_operand{ 0xff'ffff };
+
     void emit(OP opcode) {
-        bytes_.emplace_back(to_underlying(opcode));
+        emit(to_underlying(opcode));
     }
 
     void emit(Byte byte) {
+        assert(mapped_.empty() && "Cannot emit into a mapped chunk");
         bytes_.emplace_back(byte);
     }
 
-    void emit_constant(Value val) {
-        emit(OP::CONSTANT);
-        emit(constants_.emplace_back(std::move(val)));
+    // The bytes emitted from now on come from the 'location'.
+    void mark_location(const SourceLocation& location) {
+        lines_.add(size(), location);
+    }
+
+    // Drops the bytecode and the line table, but keeps the constants.
+    // For rewriting the code in place.
+    void clear_code() noexcept {
+        bytes_.clear();
+        mapped_ = {};
+        lines_ = {};
+    }
+
+    // The 'bytes' must outlive the chunk.
+    void map_bytes(std::span<const Byte> bytes) noexcept {
+        assert(bytes_.empty() && "Chunk already has bytecode");
+        mapped_ = bytes;
+    }
+
+    // 24-bit, big-endian.
+    void emit_long(size_t operand) {
+        assert(operand <= max_long_operand);
+        emit(static_cast<Byte>((operand >> 16) & 0xff));
+        emit(static_cast<Byte>((operand >> 8) & 0xff));
+        emit(static_cast<Byte>(operand & 0xff));
+    }
+
+    // The first 256 constants are loaded with a 1-byte index,
+    // the rest with CONSTANT_LONG. Returns the index of the constant.
+    size_t emit_constant(Value val) {
+        size_t index{ add_constant(std::move(val)) };
+        if (index <= UINT8_MAX) {
+            emit(OP::CONSTANT);
+            emit(static_cast<Byte>(index));
+        } else {
+            emit(OP::CONSTANT_LONG);
+            emit_long(std::min(index, max_long_operand));
+        }
+        return index;
+    }
+
+    // Returns the index, for the instructions with a constant operand.
+    // Identical numbers and strings share the index.
+    size_t add_constant(Value val) {
+        return constants_.add(std::move(val));
+    }
+
+    // Overwrites an already emitted byte, for backpatching jumps.
+    void patch(size_t offset, Byte byte) noexcept {
+        assert(offset < bytes_.size());
+        bytes_[offset] = byte;
     }
 
-    const std::vector<Byte>& bytes() const noexcept { return bytes_; }
+    // Once the code is final, see max_stack_depth().
+    void set_max_stack(size_t max_stack) noexcept { max_stack_ = max_stack; }
+
+    size_t size() const noexcept { return bytes().size(); }
+    // Most values the code has on the stack at once, above the ones there on entry.
+    size_t max_stack() const noexcept { return max_stack_; }
+
+    std::span<const Byte> bytes() const noexcept {
+        return mapped_.empty() ? std::span<const Byte>{ bytes_ } : mapped_;
+    }
     const Constants& constants() const noexcept { return constants_; }
+    const LineTable& lines() const noexcept { return lines_; }
+    LineTable& lines() noexcept { return lines_; }
 
-    auto begin() noexcept { return bytes_.begin(); }
-    auto begin() const noexcept { return bytes_.begin(); }
-    auto end() noexcept { return bytes_.end(); }
-    auto end() const noexcept { return bytes_.end(); }
+    const Byte* begin() const noexcept { return bytes().data(); }
+    const Byte* end() const noexcept { return bytes().data() + bytes().size(); }
 };
 
 
@@ -1,8 +1,14 @@
 #include "CodegenVisitor.hpp"
 #include "CommonVisitors.hpp"
+#include "Peephole.hpp"
+#include "StackDepth.hpp"
 #include "TokenType.hpp"
+#include "Utils.hpp"
 #include <fmt/format.h>
+#include <algorithm>
 #include <variant>
+#include <cassert>
+#include <cstdint>
 
 
 // Helper to signal that certain nodes of the AST are not yet implemented
@@ -26,34 +32,245 @@ void CodegenVisitor::not_implemented(const Stmt& stmt) const {
 
 
 
+CodegenVisitor::CodegenVisitor(const CodegenVisitor& enclosing, const FunStmt& function, Chunk& chunk) :
+    ErrorSender{ enclosing.error_reporter() },
+    heap_{ enclosing.heap_ }, chunk_{ chunk }, opt_level_{ enclosing.opt_level_ },
+    enclosing_{ &enclosing }, function_{ &function },
+    // Slot 0 of the frame is the function itself, parameters follow.
+    // Same as in the Resolver.
+    scope_bases_{ 0 }, num_locals_{ function.parameters.size() + 1 },
+    is_captured_local_( num_locals_, false )
+{}
+
+
+void CodegenVisitor::codegen(const Binding& binding, OP global_op, OP local_op, OP upvalue_op) const {
+    if (auto slot = global_slot(binding)) {
+        emit_global(global_op, *slot);
+        return;
+    }
+
+    if (is_captured(binding)) {
+        chunk().emit(upvalue_op);
+        emit_upvalue_index(upvalue_index(binding.slot));
+        return;
+    }
+
+    assert(binding.kind == Binding::Kind::local && "Codegen for an unresolved variable");
+    chunk().emit(local_op);
+    emit_slot(stack_slot(binding));
+}
+
+
+// The Resolver captures the globals referenced in the function body
+// by copy, like any other variable. The VM looks them up on each access instead.
+std::optional<uint32_t> CodegenVisitor::global_slot(const Binding& binding) const {
+    if (binding.kind == Binding::Kind::global) {
+        return binding.slot;
+    }
+    if (is_captured(binding)) {
+        assert(enclosing_ && function_);
+        return enclosing_->global_slot(function_->captures[binding.slot]);
+    }
+    return std::nullopt;
+}
+
+
+// Adds the upvalue for the captured variable on the first use,
+// and for the enclosing functions, if they have to pass it through.
+uint32_t CodegenVisitor::upvalue_index(uint32_t capture_slot) const {
+    assert(enclosing_ && function_);
+    if (capture_upvalues_.empty()) {
+        capture_upvalues_.resize(function_->captures.size());
+    }
+    if (capture_upvalues_[capture_slot]) {
+        return *capture_upvalues_[capture_slot];
+    }
+
+    const Binding& source{ function_->captures[capture_slot] };
+    if (enclosing_->is_captured(source)) {
+        upvalues_.push_back({ false, enclosing_->upvalue_index(source.slot) });
+    } else {
+        size_t slot{ enclosing_->stack_slot(source) };
+        enclosing_->is_captured_local_[slot] = true;
+        upvalues_.push_back({ true, static_cast<uint32_t>(slot) });
+    }
+
+    auto index = static_cast<uint32_t>(upvalues_.size() - 1);
+    capture_upvalues_[capture_slot] = index;
+    return index;
+}
+
+
+void CodegenVisitor::define_variable(uint32_t slot, const Token& name) const {
+    if (is_in_global_scope()) {
+        emit_global(OP::DEFINE_GLOBAL, slot);
+    } else {
+        if (num_locals_ > UINT8_MAX && !has_too_many_locals_) {
+            has_too_many_locals_ = true;
+            error_at(name, "Too many local variables in function");
+        }
+        // The value just stays on the stack.
+        assert(
+            error_reporter().had_errors() ||
+            scope_bases_.back() + slot == num_locals_
+        );
+        ++num_locals_;
+        // The slot could be left over from a previous block.
+        is_captured_local_.resize(num_locals_);
+        is_captured_local_.back() = false;
+    }
+}
+
+
+void CodegenVisitor::emit_global(OP op, size_t slot) const {
+    if (slot <= UINT8_MAX) {
+        chunk().emit(op);
+        chunk().emit(static_cast<Byte>(slot));
+        return;
+    }
+    if (slot > Chunk::max_long_operand) {
+        send_error("[Error @Codegen]: Too many global variables.\n");
+    }
+    chunk().emit(long_global_op(op));
+    chunk().emit_long(std::min(slot, Chunk::max_long_operand));
+}
+
+// Usually already reported, with the location, by define_variable().
+void CodegenVisitor::emit_slot(size_t slot) const {
+    if (slot > UINT8_MAX && !has_too_many_locals_) {
+        has_too_many_locals_ = true;
+        send_error("[Error @Codegen]: Too many local variables in function.\n");
+    }
+    chunk().emit(static_cast<Byte>(slot));
+}
+
+// Every upvalue is either accessed by the function itself,
+// or passed to a nested closure, so this sees each of them.
+void CodegenVisitor::emit_upvalue_index(size_t index) const {
+    if (index > UINT8_MAX && !has_too_many_upvalues_) {
+        has_too_many_upvalues_ = true;
+        send_error("[Error @Codegen]: Too many closure variables in function.\n");
+    }
+    chunk().emit(static_cast<Byte>(index));
+}
+
+
+void CodegenVisitor::error_at(const Token& token, std::string_view message) const {
+    send_error(fmt::format(
+        "[Error @Codegen] at {:s}:\n{}.\n", detail::location_info(token.location()), message
+    ));
+}
+
+
+void CodegenVisitor::emit_constant(Value value) const {
+    check_constant_index(chunk().emit_constant(value));
+}
+
+void CodegenVisitor::check_constant_index(size_t index) const {
+    if (index > Chunk::max_long_operand) {
+        send_error("[Error @Codegen]: Too many constants in one chunk.\n");
+    }
+}
+
+
+size_t CodegenVisitor::emit_jump(OP jump) const {
+    chunk().emit(jump);
+    chunk().emit(Byte{ 0xff });
+    chunk().emit(Byte{ 0xff });
+    return chunk().size() - 2;
+}
+
+void CodegenVisitor::patch_jump(size_t operand_offset) const {
+    size_t jump{ chunk().size() - operand_offset - 2 };
+    if (jump > UINT16_MAX) {
+        send_error("[Error @Codegen]: Too much code to jump over.\n");
+    }
+    chunk().patch(operand_offset, static_cast<Byte>((jump >> 8) & 0xff));
+    chunk().patch(operand_offset + 1, static_cast<Byte>(jump & 0xff));
+}
+
+void CodegenVisitor::emit_loop(size_t loop_start) const {
+    chunk().emit(OP::LOOP);
+    size_t jump{ chunk().size() - loop_start + 2 };
+    if (jump > UINT16_MAX) {
+        send_error("[Error @Codegen]: Loop body too large.\n");
+    }
+    chunk().emit(static_cast<Byte>((jump >> 8) & 0xff));
+    chunk().emit(static_cast<Byte>(jump & 0xff));
+}
+
+
+
+
 void CodegenVisitor::operator()(const LiteralExpr& expr) const {
-    assert(
-        std::holds_alternative<Number>(expr.token.literal()) &&
-        "Only Numbers are supported so far :("
-    );
-    chunk().emit_constant(std::get<Number>(expr.token.literal()));
+    mark_location(expr.token);
+    using enum TokenType;
+    switch (expr.token.type()) {
+        case number:
+            emit_constant(std::get<Number>(expr.token.literal()));
+            break;
+        case string:
+            emit_constant(
+                heap_.intern_string(std::get<String>(expr.token.literal()))
+            );
+            break;
+        case kw_true:
+            chunk().emit(OP::TRUE); break;
+        case kw_false:
+            chunk().emit(OP::FALSE); break;
+        case kw_nil:
+            chunk().emit(OP::NIL); break;
+        default:
+            not_implemented(Expr::from_alternative(expr));
+            break;
+    }
 }
 
 void CodegenVisitor::operator()(const UnaryExpr& expr) const {
-    assert(expr.op.type() == TokenType::minus);
     codegen(*expr.operand);
-    chunk().emit(OP::NEGATE);
+    mark_location(expr.op);
+    switch (expr.op.type()) {
+        case TokenType::minus:
+            chunk().emit(OP::NEGATE); break;
+        case TokenType::bang:
+            chunk().emit(OP::NOT); break;
+        default:
+            not_implemented(Expr::from_alternative(expr));
+            break;
+    }
 }
 
 void CodegenVisitor::operator()(const BinaryExpr& expr) const {
-    // Is reverse order correct?
-    codegen(*expr.rhs);
+    // Left to right, the VM pops rhs first.
     codegen(*expr.lhs);
+    codegen(*expr.rhs);
+    mark_location(expr.op);
 
+    using enum TokenType;
     switch (expr.op.type()) {
-        case TokenType::plus:
+        case plus:
             chunk().emit(OP::ADD); break;
-        case TokenType::minus:
+        case minus:
             chunk().emit(OP::SUBTRACT); break;
-        case TokenType::star:
+        case star:
             chunk().emit(OP::MULTIPLY); break;
-        case TokenType::slash:
+        case slash:
             chunk().emit(OP::DIVIDE); break;
+        case eq_eq:
+            chunk().emit(OP::EQUAL); break;
+        case bang_eq:
+            chunk().emit(OP::EQUAL);
+            chunk().emit(OP::NOT); break;
+        case greater:
+            chunk().emit(OP::GREATER); break;
+        case greater_eq:
+            chunk().emit(OP::LESS);
+            chunk().emit(OP::NOT); break;
+        case less:
+            chunk().emit(OP::LESS); break;
+        case less_eq:
+            chunk().emit(OP::GREATER);
+            chunk().emit(OP::NOT); break;
         default:
             not_implemented(Expr::from_alternative(expr));
             break;
@@ -65,19 +282,47 @@ void CodegenVisitor::operator()(const GroupedExpr& expr) const {
 }
 
 void CodegenVisitor::operator()(const VariableExpr& expr) const {
-    not_implemented(Expr::from_alternative(expr));
+    mark_location(expr.identifier);
+    codegen(expr.binding, OP::GET_GLOBAL, OP::GET_LOCAL, OP::GET_UPVALUE);
 }
 
 void CodegenVisitor::operator()(const AssignExpr& expr) const {
-    not_implemented(Expr::from_alternative(expr));
+    codegen(*expr.rvalue);
+    mark_location(expr.identifier);
+    codegen(expr.binding, OP::SET_GLOBAL, OP::SET_LOCAL, OP::SET_UPVALUE);
 }
 
 void CodegenVisitor::operator()(const LogicalExpr& expr) const {
-    not_implemented(Expr::from_alternative(expr));
+    // Short-circuits by leaving the lhs on the stack as the result.
+    codegen(*expr.lhs);
+    mark_location(expr.op);
+    if (expr.op.type() == TokenType::kw_and) {
+        size_t end_jump{ emit_jump(OP::JUMP_IF_FALSE) };
+        chunk().emit(OP::POP);
+        codegen(*expr.rhs);
+        patch_jump(end_jump);
+    } else {
+        size_t else_jump{ emit_jump(OP::JUMP_IF_FALSE) };
+        size_t end_jump{ emit_jump(OP::JUMP) };
+        patch_jump(else_jump);
+        chunk().emit(OP::POP);
+        codegen(*expr.rhs);
+        patch_jump(end_jump);
+    }
 }
 
 void CodegenVisitor::operator()(const CallExpr& expr) const {
-    not_implemented(Expr::from_alternative(expr));
+    // The callee ends up in the slot 0 of the new call frame.
+    codegen(*expr.callee);
+    for (const auto& arg : expr.args) {
+        codegen(*arg);
+    }
+    if (expr.args.size() > UINT8_MAX) {
+        send_error("[Error @Codegen]: Too many arguments.\n");
+    }
+    mark_location(expr.rparen);
+    chunk().emit(OP::CALL);
+    chunk().emit(static_cast<Byte>(expr.args.size()));
 }
 
 
@@ -88,31 +333,106 @@ void CodegenVisitor::operator()(const PrintStmt& stmt) const {
 }
 
 void CodegenVisitor::operator()(const ExpressionStmt& stmt) const {
-    not_implemented(Stmt::from_alternative(stmt));
+    codegen(*stmt.expr);
+    chunk().emit(OP::POP);
 }
 
 void CodegenVisitor::operator()(const VarStmt& stmt) const {
-    not_implemented(Stmt::from_alternative(stmt));
+    codegen(*stmt.init);
+    mark_location(stmt.identifier);
+    define_variable(stmt.slot, stmt.identifier);
 }
 
 void CodegenVisitor::operator()(const BlockStmt& stmt) const {
-    not_implemented(Stmt::from_alternative(stmt));
+    scope_bases_.push_back(num_locals_);
+    for (const auto& statement : stmt.statements) {
+        codegen(*statement);
+    }
+    for (; num_locals_ > scope_bases_.back(); --num_locals_) {
+        // Captured locals are moved off the stack into their upvalue.
+        chunk().emit(
+            is_captured_local_[num_locals_ - 1] ? OP::CLOSE_UPVALUE : OP::POP
+        );
+    }
+    scope_bases_.pop_back();
 }
 
 void CodegenVisitor::operator()(const IfStmt& stmt) const {
-    not_implemented(Stmt::from_alternative(stmt));
+    codegen(*stmt.condition);
+    size_t then_jump{ emit_jump(OP::JUMP_IF_FALSE) };
+    chunk().emit(OP::POP);
+    codegen(*stmt.then_branch);
+
+    size_t else_jump{ emit_jump(OP::JUMP) };
+    patch_jump(then_jump);
+    chunk().emit(OP::POP);
+    if (stmt.else_branch) {
+        codegen(*stmt.else_branch);
+    }
+    patch_jump(else_jump);
 }
 
 void CodegenVisitor::operator()(const WhileStmt& stmt) const {
-    not_implemented(Stmt::from_alternative(stmt));
+    size_t loop_start{ chunk().size() };
+    codegen(*stmt.condition);
+
+    size_t exit_jump{ emit_jump(OP::JUMP_IF_FALSE) };
+    chunk().emit(OP::POP);
+    codegen(*stmt.statement);
+    emit_loop(loop_start);
+
+    patch_jump(exit_jump);
+    chunk().emit(OP::POP);
 }
 
 void CodegenVisitor::operator()(const FunStmt& stmt) const {
-    not_implemented(Stmt::from_alternative(stmt));
+    Function* function{
+        heap_.make_function(std::string(stmt.name.lexeme()), stmt.parameters.size())
+    };
+
+    // The arguments are locals of the callee, and are passed with a 1-byte count.
+    if (stmt.parameters.size() > UINT8_MAX) {
+        error_at(stmt.parameters[UINT8_MAX], "Can't have more than 255 parameters");
+    }
+
+    CodegenVisitor body_codegen{ *this, stmt, function->chunk };
+    for (const auto& statement : stmt.body) {
+        body_codegen.codegen(*statement);
+    }
+    // Implicit 'return nil;'
+    function->chunk.emit(OP::NIL);
+    function->chunk.emit(OP::RETURN);
+    if (opt_level_ > 0) {
+        Peephole{ heap_ }.optimize(function->chunk);
+    }
+    // The callee and the arguments are on the stack on entry.
+    // Only empty after an error, the code never runs then.
+    function->chunk.set_max_stack(
+        max_stack_depth(function->chunk, stmt.parameters.size() + 1).value_or(0)
+    );
+    function->num_upvalues = body_codegen.upvalues_.size();
+
+    mark_location(stmt.name);
+    chunk().emit(OP::CLOSURE);
+    size_t index{ chunk().add_constant(static_cast<const Function*>(function)) };
+    check_constant_index(index);
+    chunk().emit_long(std::min(index, Chunk::max_long_operand));
+    for (const UpvalueSource& upvalue : body_codegen.upvalues_) {
+        chunk().emit(Byte{ upvalue.is_local });
+        // Where this function keeps the variable.
+        if (upvalue.is_local) {
+            emit_slot(upvalue.index);
+        } else {
+            emit_upvalue_index(upvalue.index);
+        }
+    }
+    define_variable(stmt.slot, stmt.name);
 }
 
 void CodegenVisitor::operator()(const ReturnStmt& stmt) const {
-    not_implemented(Stmt::from_alternative(stmt));
+    codegen(*stmt.expr);
+    mark_location(stmt.keyword);
+    chunk().emit(OP::RETURN);
 }
 
 void CodegenVisitor::operator()(const ImportStmt& stmt) const {
@@ -1,23 +1,65 @@
 #pragma once
 #include "Chunk.hpp"
+#include "Object.hpp"
 #include "ErrorReporter.hpp"
 #include "IError.hpp"
 #include "ErrorSender.hpp"
 #include "Expr.hpp"
 #include "Stmt.hpp"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
 
 
 
+// Where a new closure finds the captured variable: either on the stack,
+// in the frame of the enclosing function, or among the upvalues of the enclosing closure.
+// Follows the CLOSURE instruction in the bytecode, one per upvalue.
+struct UpvalueSource {
+    bool is_local;
+    uint32_t index;
+};
 
 
 
 class CodegenVisitor : private ErrorSender<SimpleError> {
 private:
+    Heap& heap_;
     Chunk& chunk_;
+    // Run the Peephole over the function bodies if above 0.
+    int opt_level_;
+
+    // Set when generating the body of a function.
+    const CodegenVisitor* enclosing_{ nullptr };
+    const FunStmt* function_{ nullptr };
+
+    // The locals live on the VM stack, in the order of declaration.
+    // For each enclosing block, the number of locals that were
+    // already on the stack when the block was entered.
+    // Empty in the global scope. Inside of a function,
+    // the base of the function scope is the base of the call frame.
+    mutable std::vector<size_t> scope_bases_;
+    mutable size_t num_locals_{ 0 };
+
+    // Indexed by the stack slot. Marks the locals captured by
+    // the nested functions, they are closed when leaving the scope.
+    mutable std::vector<bool> is_captured_local_;
+    // The limits on the locals and the upvalues are reported
+    // at the first one past them, not at every use.
+    mutable bool has_too_many_locals_{ false };
+    mutable bool has_too_many_upvalues_{ false };
+
+    // For the function: the upvalue index of each of the Resolver's
+    // captures, and where to find the upvalues when creating the closure.
+    // Captured globals do not get an upvalue.
+    mutable std::vector<std::optional<uint32_t>> capture_upvalues_;
+    mutable std::vector<UpvalueSource> upvalues_;
 
 public:
-    CodegenVisitor(ErrorReporter& err, Chunk& chunk) :
-        ErrorSender{ err }, chunk_{ chunk }
+    CodegenVisitor(ErrorReporter& err, Heap& heap, Chunk& chunk, int opt_level = 0) :
+        ErrorSender{ err }, heap_{ heap }, chunk_{ chunk }, opt_level_{ opt_level }
     {}
 
     void operator()(const LiteralExpr& expr) const;
@@ -39,10 +81,56 @@ public:
     void operator()(const ReturnStmt& stmt) const;
     void operator()(const ImportStmt& stmt) const;
 private:
+    // For the body of the 'function', declared in the 'enclosing' scope.
+    CodegenVisitor(const CodegenVisitor& enclosing, const FunStmt& function, Chunk& chunk);
+
     Chunk& chunk() const noexcept { return chunk_; }
     void not_implemented(const Expr& expr) const;
     void not_implemented(const Stmt& stmt) const;
 
+    void codegen(const Binding& binding, OP global_op, OP local_op, OP upvalue_op) const;
+
+    // The global slot of the variable, if the binding refers to a global,
+    // either directly or through the captures of the enclosing functions.
+    std::optional<uint32_t> global_slot(const Binding& binding) const;
+
+    bool is_captured(const Binding& binding) const noexcept {
+        return binding.kind == Binding::Kind::local &&
+            binding.depth >= scope_bases_.size();
+    }
+
+    // Relative to the base of the call frame.
+    size_t stack_slot(const Binding& binding) const noexcept {
+        return scope_bases_[scope_bases_.size() - 1 - binding.depth] + binding.slot;
+    }
+
+    uint32_t upvalue_index(uint32_t capture_slot) const;
+
+    void define_variable(uint32_t slot, const Token& name) const;
+
+    // Picks the 1-byte or the 24-bit form of the 'op' by the slot.
+    void emit_global(OP op, size_t slot) const;
+    // Of a local of this function.
+    void emit_slot(size_t slot) const;
+    // Of an upvalue of this function.
+    void emit_upvalue_index(size_t index) const;
+
+    void error_at(const Token& token, std::string_view message) const;
+
+    void mark_location(const Token& token) const {
+        chunk().mark_location(token.location());
+    }
+
+    void emit_constant(Value value) const;
+    void check_constant_index(size_t index) const;
+
+    // Returns the offset of the jump operand, to patch later.
+    size_t emit_jump(OP jump) const;
+    void patch_jump(size_t operand_offset) const;
+    void emit_loop(size_t loop_start) const;
+
+    bool is_in_global_scope() const noexcept { return scope_bases_.empty(); }
+
     void codegen(const Expr& expr) const {
         expr.accept(*this);
     }
@@ -1,12 +1,20 @@
 #pragma once
 #include "Value.hpp"
+#include <boost/unordered_map.hpp>
+#include <bit>
 #include <vector>
 #include <utility>
+#include <cstdint>
 
 class Constants {
 private:
     std::vector<Value> values_;
 
+    // For deduplication: the numbers by their bits, so that 0 and -0 differ,
+    // and the strings by identity, the literals are interned by the Heap.
+    boost::unordered_map<uint64_t, size_t> number_indices_;
+    boost::unordered_map<const String*, size_t> string_indices_;
+
 public:
     template<typename ...Args>
     size_t emplace_back(Args&&... args) {
@@ -14,6 +22,17 @@ public:
         return &elem - values_.data();
     }
 
+    // Reuses the slot of an identical number or string, if there is one.
+    size_t add(Value value) {
+        if (value.is<Number>()) {
+            return find_or_add(number_indices_, std::bit_cast<uint64_t>(value.as<Number>()), value);
+        }
+        if (value.is<const String*>()) {
+            return find_or_add(string_indices_, value.as<const String*>(), value);
+        }
+        return emplace_back(value);
+    }
+
     Value& operator[](size_t idx) noexcept {
         assert(idx < values_.size() && "Out of bounds access");
         return values_[idx];
@@ -24,4 +43,16 @@ public:
         return values_[idx];
     }
 
+    size_t size() const noexcept { return values_.size(); }
+
+private:
+    template<typename Key>
+    size_t find_or_add(boost::unordered_map<Key, size_t>& indices, Key key, Value value) {
+        auto [it, inserted] = indices.try_emplace(key, values_.size());
+        if (inserted) {
+            values_.emplace_back(value);
+        }
+        return it->second;
+    }
+
 };
@@ -1,25 +1,40 @@
 #pragma once
 #include "Chunk.hpp"
+#include "Object.hpp"
 #include <fmt/format.h>
+#include <optional>
 #include <string>
 #include <utility>
+#include <span>
 #include <vector>
+#include <cstdint>
 
 
 class Disassembler {
 private:
     std::string repr_;
     const Chunk* current_;
-    using iter_t = std::vector<Byte>::const_iterator;
+    std::optional<SourceLocation> last_location_;
+    using iter_t = const Byte*;
 
 public:
     [[nodiscard]]
     std::string disassemble(const std::string& name, const Chunk& chungus) {
         reset(chungus);
         add_chunk_label(name);
-        for (auto it{ bytes().begin() }; it != bytes().end(); /*_*/) {
+        for (iter_t it{ chungus.begin() }; it != chungus.end(); /*_*/) {
             it = disassemble_instruction(it);
         }
+        // Then the bodies of the functions declared in this chunk.
+        for (size_t i{ 0 }; i < chungus.constants().size(); ++i) {
+            const Value& constant{ chungus.constants()[i] };
+            if (constant.is<const Function*>()) {
+                const Function& function{ *constant.as<const Function*>() };
+                std::string repr{ std::move(repr_) };
+                repr += disassemble(function.name, function.chunk);
+                repr_ = std::move(repr);
+            }
+        }
         return std::move(repr_);
     }
 
@@ -27,40 +42,68 @@ private:
     iter_t disassemble_instruction(iter_t it) {
         Byte byte{ *it };
         switch(OP{ byte }) {
-            case OP::RETURN:
-                add_op_line(it, "RETURN");
-                ++it;
-                break;
             case OP::CONSTANT: {
                     auto index = *(it + 1);
-                    add_op_line(it, fmt::format("CONSTANT {} ({})", index, current_->constants()[index]));
+                    add_op_line(it, fmt::format("CONSTANT {} ({})", index, to_string(current_->constants()[index])));
                     ++it;
                     ++it; // Skip constant
                 }
                 break;
-            case OP::NEGATE:
-                add_op_line(it, "NEGATE");
-                ++it;
-                break;
-            case OP::ADD:
-                add_op_line(it, "ADD");
-                ++it;
-                break;
-            case OP::SUBTRACT:
-                add_op_line(it, "SUBTRACT");
-                ++it;
-                break;
-            case OP::MULTIPLY:
-                add_op_line(it, "MULTIPLY");
-                ++it;
+            case OP::CONSTANT_LONG: {
+                    auto index = long_operand(it);
+                    add_op_line(it, fmt::format("CONSTANT_LONG {} ({})", index, to_string(current_->constants()[index])));
+                    it += 4;
+                }
                 break;
-            case OP::DIVIDE:
-                add_op_line(it, "DIVIDE");
-                ++it;
+            case OP::GET_GLOBAL: it = byte_instruction(it, "GET_GLOBAL"); break;
+            case OP::SET_GLOBAL: it = byte_instruction(it, "SET_GLOBAL"); break;
+            case OP::DEFINE_GLOBAL: it = byte_instruction(it, "DEFINE_GLOBAL"); break;
+            case OP::GET_GLOBAL_LONG: it = long_instruction(it, "GET_GLOBAL_LONG"); break;
+            case OP::SET_GLOBAL_LONG: it = long_instruction(it, "SET_GLOBAL_LONG"); break;
+            case OP::DEFINE_GLOBAL_LONG: it = long_instruction(it, "DEFINE_GLOBAL_LONG"); break;
+            case OP::GET_LOCAL: it = byte_instruction(it, "GET_LOCAL"); break;
+            case OP::SET_LOCAL: it = byte_instruction(it, "SET_LOCAL"); break;
+            case OP::JUMP: it = jump_instruction(it, "JUMP", 1); break;
+            case OP::JUMP_IF_FALSE: it = jump_instruction(it, "JUMP_IF_FALSE", 1); break;
+            case OP::LOOP: it = jump_instruction(it, "LOOP", -1); break;
+            case OP::RETURN: it = simple_instruction(it, "RETURN"); break;
+            case OP::NIL: it = simple_instruction(it, "NIL"); break;
+            case OP::TRUE: it = simple_instruction(it, "TRUE"); break;
+            case OP::FALSE: it = simple_instruction(it, "FALSE"); break;
+            case OP::POP: it = simple_instruction(it, "POP"); break;
+            case OP::EQUAL: it = simple_instruction(it, "EQUAL"); break;
+            case OP::GREATER: it = simple_instruction(it, "GREATER"); break;
+            case OP::LESS: it = simple_instruction(it, "LESS"); break;
+            case OP::NEGATE: it = simple_instruction(it, "NEGATE"); break;
+            case OP::NOT: it = simple_instruction(it, "NOT"); break;
+            case OP::ADD: it = simple_instruction(it, "ADD"); break;
+            case OP::SUBTRACT: it = simple_instruction(it, "SUBTRACT"); break;
+            case OP::MULTIPLY: it = simple_instruction(it, "MULTIPLY"); break;
+            case OP::DIVIDE: it = simple_instruction(it, "DIVIDE"); break;
+            case OP::PRINT: it = simple_instruction(it, "PRINT"); break;
+            case OP::CALL: it = byte_instruction(it, "CALL"); break;
+            case OP::CLOSURE: it = closure_instruction(it); break;
+            case OP::GET_UPVALUE: it = byte_instruction(it, "GET_UPVALUE"); break;
+            case OP::SET_UPVALUE: it = byte_instruction(it, "SET_UPVALUE"); break;
+            case OP::CLOSE_UPVALUE: it = simple_instruction(it, "CLOSE_UPVALUE"); break;
+            case OP::NOT_EQUAL: it = simple_instruction(it, "NOT_EQUAL"); break;
+            case OP::SET_LOCAL_POP: it = byte_instruction(it, "SET_LOCAL_POP"); break;
+            case OP::SET_GLOBAL_POP: it = byte_instruction(it, "SET_GLOBAL_POP"); break;
+            case OP::GET_LOCAL2:
+                add_op_line(it, fmt::format("GET_LOCAL2 {:d} {:d}", *(it + 1), *(it + 2)));
+                it += 3;
                 break;
-            case OP::PRINT:
-                add_op_line(it, "PRINT");
-                ++it;
+            case OP::ADD_LOCAL_CONST: it = local_constant_instruction(it, "ADD_LOCAL_CONST"); break;
+            case OP::SUBTRACT_LOCAL_CONST: it = local_constant_instruction(it, "SUBTRACT_LOCAL_CONST"); break;
+            case OP::LESS_LOCAL_CONST_JUMP: {
+                    auto jump = static_cast<uint16_t>((*(it + 3) << 8) | *(it + 4));
+                    auto target = offset(it) + 5 + jump;
+                    add_op_line(it, fmt::format(
+                        "LESS_LOCAL_CONST_JUMP {:d} {:d} ({}) {:04d}",
+                        *(it + 1), *(it + 2), to_string(current_->constants()[*(it + 2)]), target
+                    ));
+                    it += 5;
+                }
                 break;
             default:
                 add_op_line(it, fmt::format("UNKNOWN[{:d}]", byte));
@@ -70,12 +113,67 @@ private:
         return it;
     }
 
+    iter_t simple_instruction(iter_t it, const char* name) {
+        add_op_line(it, name);
+        return it + 1;
+    }
+
+    iter_t byte_instruction(iter_t it, const char* name) {
+        add_op_line(it, fmt::format("{} {:d}", name, *(it + 1)));
+        return it + 2;
+    }
+
+    iter_t long_instruction(iter_t it, const char* name) {
+        add_op_line(it, fmt::format("{} {}", name, long_operand(it)));
+        return it + 4;
+    }
+
+    iter_t jump_instruction(iter_t it, const char* name, int sign) {
+        auto jump = static_cast<uint16_t>((*(it + 1) << 8) | *(it + 2));
+        auto target = static_cast<long>(offset(it)) + 3 + sign * jump;
+        add_op_line(it, fmt::format("{} {:04d}", name, target));
+        return it + 3;
+    }
+
+    // [stack slot] [constant index]
+    iter_t local_constant_instruction(iter_t it, const char* name) {
+        add_op_line(it, fmt::format(
+            "{} {:d} {:d} ({})", name, *(it + 1), *(it + 2), to_string(current_->constants()[*(it + 2)])
+        ));
+        return it + 3;
+    }
+
+    iter_t closure_instruction(iter_t it) {
+        auto index = long_operand(it);
+        const Value& constant{ current_->constants()[index] };
+        add_op_line(it, fmt::format("CLOSURE {} ({})", index, to_string(constant)));
+        it += 4;
+        for (size_t i{ 0 }; i < constant.as<const Function*>()->num_upvalues; ++i) {
+            add_line(fmt::format(
+                "   | {} {:d}", *it ? "local" : "upvalue", *(it + 1)
+            ));
+            it += 2;
+        }
+        return it;
+    }
+
+    size_t long_operand(iter_t it) const noexcept {
+        return (size_t(*(it + 1)) << 16) | (size_t(*(it + 2)) << 8) | *(it + 3);
+    }
+
     void add_chunk_label(const std::string& label) {
         add_line(fmt::format("{:s}:", label));
     }
 
+    // Shows the source location, unless it's the same as for the previous instruction.
     void add_op_line(iter_t it, const std::string& line) {
-        add_line(fmt::format("{:04d} {}", offset(it), line));
+        auto location = current().lines().find(offset(it));
+        std::string where{ "   |" };
+        if (location && location != last_location_) {
+            where = fmt::format("{:>4d}:{:<3d}", location->line, location->column);
+        }
+        last_location_ = std::move(location);
+        add_line(fmt::format("{:04d} {:<8s} {}", offset(it), where, line));
     }
 
     void add_line(const std::string& line) {
@@ -85,10 +183,11 @@ private:
     void reset(const Chunk& chunk) {
         repr_.clear();
         current_ = &chunk;
+        last_location_.reset();
     }
 
-    size_t offset(iter_t it) const noexcept { return it - bytes().begin(); }
+    size_t offset(iter_t it) const noexcept { return it - bytes().data(); }
     const Chunk& current() const noexcept { return *current_; }
-    const std::vector<Byte>& bytes() const noexcept { return current().bytes(); }
+    std::span<const Byte> bytes() const noexcept { return current().bytes(); }
 
 };
@@ -0,0 +1,82 @@
+#pragma once
+#include "SourceLocation.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+
+// Maps the offsets in the bytecode to the source locations.
+// Run-length encoded: one entry per run of bytes that came from the same location.
+// Lives apart from the bytecode, and is only looked at when reporting errors.
+class LineTable {
+public:
+    struct Run {
+        uint32_t offset; // Of the first byte in the run.
+        uint16_t line;
+        uint16_t column;
+        uint32_t file_id;
+    };
+
+private:
+    std::vector<Run> runs_;
+    // Indexed by the file_id. Ids in the FileTable, can be FileTable::no_file.
+    std::vector<FileTable::Id> files_;
+
+public:
+    // The bytes starting from the 'offset' come from the 'location'.
+    void add(size_t offset, const SourceLocation& location) {
+        uint32_t file_id{ find_or_add_file(location.file_id) };
+        Run run{ static_cast<uint32_t>(offset), location.line, location.column, file_id };
+        if (!runs_.empty()) {
+            Run& last{ runs_.back() };
+            assert(last.offset <= run.offset);
+            if (last.offset == run.offset) {
+                last = run;
+                return;
+            }
+            if (last.line == run.line && last.column == run.column && last.file_id == run.file_id) {
+                return;
+            }
+        }
+        runs_.push_back(run);
+    }
+
+    // For the loader of the cached bytecode, the runs must be sorted by offset.
+    void add_run(Run run) { runs_.push_back(run); }
+
+    void add_file(FileTable::Id file) {
+        files_.push_back(file);
+    }
+
+    // O(log n) in the number of runs.
+    std::optional<SourceLocation> find(size_t offset) const {
+        auto it = std::upper_bound(
+            runs_.begin(), runs_.end(), offset,
+            [](size_t offset, const Run& run) { return offset < run.offset; }
+        );
+        if (it == runs_.begin()) {
+            return {};
+        }
+        --it;
+        return SourceLocation{ it->line, it->column, files_[it->file_id] };
+    }
+
+    std::span<const Run> runs() const noexcept { return runs_; }
+    std::span<const FileTable::Id> files() const noexcept { return files_; }
+
+private:
+    uint32_t find_or_add_file(FileTable::Id file) {
+        // Few files per chunk.
+        auto it = std::find(files_.begin(), files_.end(), file);
+        if (it == files_.end()) {
+            files_.push_back(file);
+            return static_cast<uint32_t>(files_.size() - 1);
+        }
+        return static_cast<uint32_t>(it - files_.begin());
+    }
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include "Chunk.hpp"
+#include "Value.hpp"
+#include <boost/unordered_map.hpp>
+#include <deque>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Compiled lox function. Owns the bytecode of it's body.
+struct Function {
+    std::string name;
+    size_t arity;
+    Chunk chunk;
+    size_t num_upvalues{ 0 };
+};
+
+
+// Variable captured by a closure. While the variable is still
+// on the stack, the upvalue is open and refers to it by the stack index.
+// When the variable goes out of scope, it's value is moved
+// into the upvalue itself.
+struct Upvalue {
+    size_t slot;
+    Value closed{};
+    bool is_open{ true };
+};
+
+
+// Function together with the variables it captured.
+// Created at runtime, by the CLOSURE instruction.
+struct Closure {
+    const Function* function;
+    std::vector<Upvalue*> upvalues;
+};
+
+
+using native_function_t = Value(*)(std::span<Value>);
+
+struct NativeFunction {
+    const char* name;
+    size_t arity;
+    native_function_t fun;
+};
+
+
+
+// The NaN-boxed Value keeps the type of the object in the low bits of the pointer.
+static_assert(alignof(String) >= 8 && alignof(Function) >= 8);
+static_assert(alignof(NativeFunction) >= 8 && alignof(Closure) >= 8);
+
+
+// Owns all of the objects created by the codegen and the VM.
+// There's no garbage collection yet, everything lives
+// for as long as the Heap itself.
+class Heap {
+private:
+    // Deques, so that the addresses are stable.
+    std::deque<String> strings_;
+    std::deque<Function> functions_;
+    std::deque<NativeFunction> natives_;
+    std::deque<Closure> closures_;
+    std::deque<Upvalue> upvalues_;
+    // The string literals, so that the identical ones are shared.
+    boost::unordered_map<String, const String*> interned_;
+
+public:
+    template<typename ...Args>
+    const String* make_string(Args&&... args) {
+        return &strings_.emplace_back(std::forward<Args>(args)...);
+    }
+
+    const String* intern_string(const String& string) {
+        auto [it, inserted] = interned_.try_emplace(string, nullptr);
+        if (inserted) {
+            it->second = make_string(string);
+        }
+        return it->second;
+    }
+
+    Function* make_function(std::string name, size_t arity) {
+        return &functions_.emplace_back(Function{ std::move(name), arity, {} });
+    }
+
+    const NativeFunction* make_native(const char* name, size_t arity, native_function_t fun) {
+        return &natives_.emplace_back(NativeFunction{ name, arity, fun });
+    }
+
+    Closure* make_closure(const Function* function) {
+        return &closures_.emplace_back(Closure{ function, {} });
+    }
+
+    Upvalue* make_upvalue(size_t slot) {
+        return &upvalues_.emplace_back(Upvalue{ slot });
+    }
+};
@@ -1,18 +1,159 @@
 #pragma once
+#include <string_view>
 #include <cstdint>
 #include <cstddef>
 
 using Byte = unsigned char;
 
 // Capital letters make it *feel* low-level
+//
+// Operands, if any, follow the opcode in the bytecode.
+// Jump offsets are 16-bit, big-endian, counted from
+// the byte right after the operand.
 enum class OP : Byte {
-    RETURN,
-    CONSTANT,
+    RETURN,         // Returns the value on top of the stack
+    CONSTANT,       // [constant index]
+    CONSTANT_LONG,  // [constant index, 24-bit big-endian]
+    NIL,
+    TRUE,
+    FALSE,
+    POP,
+    GET_GLOBAL,     // [global slot]
+    SET_GLOBAL,     // [global slot]
+    DEFINE_GLOBAL,  // [global slot]
+    GET_GLOBAL_LONG,    // [global slot, 24-bit big-endian]
+    SET_GLOBAL_LONG,    // [global slot, 24-bit big-endian]
+    DEFINE_GLOBAL_LONG, // [global slot, 24-bit big-endian]
+    GET_LOCAL,      // [stack slot]
+    SET_LOCAL,      // [stack slot]
+    EQUAL,
+    GREATER,
+    LESS,
     NEGATE,
+    NOT,
     ADD,
     SUBTRACT,
     MULTIPLY,
     DIVIDE,
     PRINT,
+    JUMP,           // [offset hi] [offset lo]
+    JUMP_IF_FALSE,  // [offset hi] [offset lo], does not pop the condition
+    LOOP,           // [offset hi] [offset lo], jumps backwards
+    CALL,           // [number of arguments]
+    CLOSURE,        // [constant index, 24-bit] followed by [is local] [index] per upvalue
+    GET_UPVALUE,    // [upvalue index]
+    SET_UPVALUE,    // [upvalue index]
+    CLOSE_UPVALUE,  // Moves the local on top of the stack into it's upvalue, pops
+
+    // Fused pairs, only emitted by the Peephole optimizer.
+    NOT_EQUAL,      // EQUAL, NOT
+    SET_LOCAL_POP,  // [stack slot], SET_LOCAL, POP
+    SET_GLOBAL_POP, // [global slot], SET_GLOBAL, POP
+
+    // Superinstructions for the hot sequences in loops, also only emitted by the Peephole.
+    GET_LOCAL2,             // [stack slot] [stack slot], two GET_LOCAL
+    ADD_LOCAL_CONST,        // [stack slot] [constant index], GET_LOCAL, CONSTANT, ADD
+    SUBTRACT_LOCAL_CONST,   // [stack slot] [constant index], GET_LOCAL, CONSTANT, SUBTRACT
+    LESS_LOCAL_CONST_JUMP,  // [stack slot] [constant index] [offset hi] [offset lo],
+                            // jumps if the local is not less than the constant.
+                            // Replaces GET_LOCAL, CONSTANT, LESS, JUMP_IF_FALSE
+                            // and the POP of the condition on both paths.
 };
 
+inline constexpr size_t num_opcodes{ size_t(OP::LESS_LOCAL_CONST_JUMP) + 1 };
+
+
+// The first 256 globals are addressed with a 1-byte slot,
+// the rest with the _LONG form of the instruction.
+constexpr OP long_global_op(OP op) noexcept {
+    switch (op) {
+        case OP::GET_GLOBAL: return OP::GET_GLOBAL_LONG;
+        case OP::SET_GLOBAL: return OP::SET_GLOBAL_LONG;
+        case OP::DEFINE_GLOBAL: return OP::DEFINE_GLOBAL_LONG;
+        default: return op;
+    }
+}
+
+
+// Bytes of the operands following the opcode. Not counting
+// the [is local] [index] pairs of CLOSURE, those depend on the function.
+constexpr size_t operand_size(OP op) noexcept {
+    switch (op) {
+        case OP::CONSTANT:
+        case OP::GET_GLOBAL:
+        case OP::SET_GLOBAL:
+        case OP::DEFINE_GLOBAL:
+        case OP::GET_LOCAL:
+        case OP::SET_LOCAL:
+        case OP::CALL:
+        case OP::GET_UPVALUE:
+        case OP::SET_UPVALUE:
+        case OP::SET_LOCAL_POP:
+        case OP::SET_GLOBAL_POP:
+            return 1;
+        case OP::JUMP:
+        case OP::JUMP_IF_FALSE:
+        case OP::LOOP:
+        case OP::GET_LOCAL2:
+        case OP::ADD_LOCAL_CONST:
+        case OP::SUBTRACT_LOCAL_CONST:
+            return 2;
+        case OP::CONSTANT_LONG:
+        case OP::GET_GLOBAL_LONG:
+        case OP::SET_GLOBAL_LONG:
+        case OP::DEFINE_GLOBAL_LONG:
+        case OP::CLOSURE:
+            return 3;
+        case OP::LESS_LOCAL_CONST_JUMP:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+
+constexpr std::string_view opcode_name(OP op) noexcept {
+    switch (op) {
+        case OP::RETURN: return "RETURN";
+        case OP::CONSTANT: return "CONSTANT";
+        case OP::CONSTANT_LONG: return "CONSTANT_LONG";
+        case OP::NIL: return "NIL";
+        case OP::TRUE: return "TRUE";
+        case OP::FALSE: return "FALSE";
+        case OP::POP: return "POP";
+        case OP::GET_GLOBAL: return "GET_GLOBAL";
+        case OP::SET_GLOBAL: return "SET_GLOBAL";
+        case OP::DEFINE_GLOBAL: return "DEFINE_GLOBAL";
+        case OP::GET_GLOBAL_LONG: return "GET_GLOBAL_LONG";
+        case OP::SET_GLOBAL_LONG: return "SET_GLOBAL_LONG";
+        case OP::DEFINE_GLOBAL_LONG: return "DEFINE_GLOBAL_LONG";
+        case OP::GET_LOCAL: return "GET_LOCAL";
+        case OP::SET_LOCAL: return "SET_LOCAL";
+        case OP::EQUAL: return "EQUAL";
+        case OP::GREATER: return "GREATER";
+        case OP::LESS: return "LESS";
+        case OP::NEGATE: return "NEGATE";
+        case OP::NOT: return "NOT";
+        case OP::ADD: return "ADD";
+        case OP::SUBTRACT: return "SUBTRACT";
+        case OP::MULTIPLY: return "MULTIPLY";
+        case OP::DIVIDE: return "DIVIDE";
+        case OP::PRINT: return "PRINT";
+        case OP::JUMP: return "JUMP";
+        case OP::JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+        case OP::LOOP: return "LOOP";
+        case OP::CALL: return "CALL";
+        case OP::CLOSURE: return "CLOSURE";
+        case OP::GET_UPVALUE: return "GET_UPVALUE";
+        case OP::SET_UPVALUE: return "SET_UPVALUE";
+        case OP::CLOSE_UPVALUE: return "CLOSE_UPVALUE";
+        case OP::NOT_EQUAL: return "NOT_EQUAL";
+        case OP::SET_LOCAL_POP: return "SET_LOCAL_POP";
+        case OP::SET_GLOBAL_POP: return "SET_GLOBAL_POP";
+        case OP::GET_LOCAL2: return "GET_LOCAL2";
+        case OP::ADD_LOCAL_CONST: return "ADD_LOCAL_CONST";
+        case OP::SUBTRACT_LOCAL_CONST: return "SUBTRACT_LOCAL_CONST";
+        case OP::LESS_LOCAL_CONST_JUMP: return "LESS_LOCAL_CONST_JUMP";
+    }
+    return "UNKNOWN";
+}
@@ -0,0 +1,92 @@
+#include "OpProfiler.hpp"
+
+#include <fmt/format.h>
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+
+
+namespace {
+
+double percent(uint64_t part, uint64_t total) noexcept {
+    return total == 0 ? 0.0 : 100.0 * double(part) / double(total);
+}
+
+} // namespace
+
+
+
+
+std::string OpProfiler::report(size_t max_pairs) const {
+    std::string repr;
+#ifdef LOX_HAS_RDTSC
+    const char* unit{ "cycles" };
+#else
+    const char* unit{ "ticks" };
+#endif
+
+    uint64_t total{ std::accumulate(counts_.begin(), counts_.end(), uint64_t{ 0 }) };
+    uint64_t total_ticks{ std::accumulate(ticks_.begin(), ticks_.end(), uint64_t{ 0 }) };
+
+    std::vector<OP> ops;
+    for (size_t i{ 0 }; i < num_opcodes; ++i) {
+        if (counts_[i] != 0) {
+            ops.push_back(OP(i));
+        }
+    }
+    std::sort(ops.begin(), ops.end(), [this](OP lhs, OP rhs) {
+        return counts_[size_t(lhs)] > counts_[size_t(rhs)];
+    });
+
+    repr += fmt::format("Executed {:d} instructions:\n", total);
+    repr += fmt::format("{:<24s}{:>14s}{:>8s}", "opcode", "count", "%");
+    if (count_ticks_) {
+        repr += fmt::format("{:>16s}{:>8s}{:>10s}", unit, "%", "per op");
+    }
+    repr += '\n';
+    for (OP op : ops) {
+        uint64_t count{ counts_[size_t(op)] };
+        repr += fmt::format(
+            "{:<24s}{:>14d}{:>8.2f}", opcode_name(op), count, percent(count, total)
+        );
+        if (count_ticks_) {
+            uint64_t op_ticks{ ticks_[size_t(op)] };
+            repr += fmt::format(
+                "{:>16d}{:>8.2f}{:>10.1f}",
+                op_ticks, percent(op_ticks, total_ticks), double(op_ticks) / double(count)
+            );
+        }
+        repr += '\n';
+    }
+
+    // (count, previous, next)
+    std::vector<std::tuple<uint64_t, OP, OP>> pairs;
+    uint64_t total_pairs{ 0 };
+    for (size_t i{ 0 }; i < num_opcodes; ++i) {
+        for (size_t j{ 0 }; j < num_opcodes; ++j) {
+            if (pairs_[i][j] != 0) {
+                pairs.emplace_back(pairs_[i][j], OP(i), OP(j));
+                total_pairs += pairs_[i][j];
+            }
+        }
+    }
+    size_t shown{ std::min(max_pairs, pairs.size()) };
+    std::partial_sort(
+        pairs.begin(), pairs.begin() + std::ptrdiff_t(shown), pairs.end(),
+        [](const auto& lhs, const auto& rhs) { return std::get<0>(lhs) > std::get<0>(rhs); }
+    );
+
+    repr += fmt::format("\nTop {:d} of {:d} opcode pairs:\n", shown, pairs.size());
+    repr += fmt::format("{:<48s}{:>14s}{:>8s}\n", "pair", "count", "%");
+    for (size_t i{ 0 }; i < shown; ++i) {
+        auto [count, previous, next] = pairs[i];
+        repr += fmt::format(
+            "{:<48s}{:>14d}{:>8.2f}\n",
+            fmt::format("{:s} -> {:s}", opcode_name(previous), opcode_name(next)),
+            count, percent(count, total_pairs)
+        );
+    }
+    return repr;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "OpCode.hpp"
+#include <array>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#if __has_include(<x86intrin.h>) && (defined(__x86_64__) || defined(__i386__))
+#define LOX_HAS_RDTSC
+#include <x86intrin.h>
+#endif
+
+
+// Counts the executed instructions, per opcode and per pair of
+// consecutive opcodes, and optionally the time spent in each opcode.
+// The time is in cycles where rdtsc is available, otherwise
+// in the ticks of the steady_clock. Includes the profiling overhead itself,
+// so only good for comparing the opcodes to each other.
+//
+// Fed by the VM only when built with the LOX_VM_PROFILING option.
+class OpProfiler {
+private:
+    std::array<uint64_t, num_opcodes> counts_{};
+    // Indexed by [previous][next].
+    std::array<std::array<uint64_t, num_opcodes>, num_opcodes> pairs_{};
+    std::array<uint64_t, num_opcodes> ticks_{};
+    bool count_ticks_;
+
+    std::optional<OP> previous_;
+    uint64_t previous_start_{ 0 };
+
+public:
+    explicit OpProfiler(bool count_ticks) : count_ticks_{ count_ticks } {}
+
+    void record(OP op) noexcept {
+        ++counts_[size_t(op)];
+        if (count_ticks_) {
+            uint64_t now{ ticks() };
+            if (previous_) {
+                ticks_[size_t(*previous_)] += now - previous_start_;
+            }
+            previous_start_ = now;
+        }
+        if (previous_) {
+            ++pairs_[size_t(*previous_)][size_t(op)];
+        }
+        previous_ = op;
+    }
+
+    // At the end of the run. The next recorded opcode does not pair with the last one.
+    void finish() noexcept {
+        if (previous_ && count_ticks_) {
+            ticks_[size_t(*previous_)] += ticks() - previous_start_;
+        }
+        previous_.reset();
+    }
+
+    // Tables of the opcodes and of the 'max_pairs' most frequent pairs,
+    // sorted by the count.
+    std::string report(size_t max_pairs = 20) const;
+
+private:
+    static uint64_t ticks() noexcept {
+#ifdef LOX_HAS_RDTSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+};
@@ -0,0 +1,566 @@
+#include "Peephole.hpp"
+
+#include "Object.hpp"
+#include "Value.hpp"
+#include <span>
+#include <utility>
+
+
+
+namespace {
+
+bool has_byte_operand(OP op) noexcept {
+    switch (op) {
+        case OP::GET_GLOBAL:
+        case OP::SET_GLOBAL:
+        case OP::DEFINE_GLOBAL:
+        case OP::GET_LOCAL:
+        case OP::SET_LOCAL:
+        case OP::CALL:
+        case OP::GET_UPVALUE:
+        case OP::SET_UPVALUE:
+        case OP::SET_LOCAL_POP:
+        case OP::SET_GLOBAL_POP:
+        case OP::GET_LOCAL2:
+        case OP::ADD_LOCAL_CONST:
+        case OP::SUBTRACT_LOCAL_CONST:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Byte operands preceding the last operand.
+size_t num_args(OP op) noexcept {
+    switch (op) {
+        case OP::GET_LOCAL2:
+        case OP::ADD_LOCAL_CONST:
+        case OP::SUBTRACT_LOCAL_CONST:
+            return 1;
+        case OP::LESS_LOCAL_CONST_JUMP:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+OP short_global_op(OP op) noexcept {
+    switch (op) {
+        case OP::GET_GLOBAL_LONG: return OP::GET_GLOBAL;
+        case OP::SET_GLOBAL_LONG: return OP::SET_GLOBAL;
+        case OP::DEFINE_GLOBAL_LONG: return OP::DEFINE_GLOBAL;
+        default: return op;
+    }
+}
+
+bool is_jump(OP op) noexcept {
+    return op == OP::JUMP || op == OP::JUMP_IF_FALSE || op == OP::LOOP ||
+        op == OP::LESS_LOCAL_CONST_JUMP;
+}
+
+// Never continues to the next instruction.
+bool is_unconditional(OP op) noexcept {
+    return op == OP::JUMP || op == OP::LOOP || op == OP::RETURN;
+}
+
+// Pushes a value without any other effect.
+bool is_pure_push(OP op) noexcept {
+    switch (op) {
+        case OP::CONSTANT:
+        case OP::NIL:
+        case OP::TRUE:
+        case OP::FALSE:
+        case OP::GET_LOCAL:
+        case OP::GET_GLOBAL:
+        case OP::GET_UPVALUE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+
+
+
+void Peephole::optimize(Chunk& chunk) {
+    chunk_ = &chunk;
+    // To put back if the result cannot be encoded.
+    std::vector<Byte> original{ chunk.begin(), chunk.end() };
+    LineTable original_lines{ chunk.lines() };
+    decode();
+    bool changed{ true };
+    while (changed) {
+        mark_jump_targets();
+        changed = false;
+        changed |= fold_constants();
+        changed |= thread_jumps();
+        changed |= remove_dead_pushes();
+        changed |= fuse_pairs();
+    }
+    mark_jump_targets();
+    select_superinstructions();
+    // The jumps over the dropped POPs may now go to the next instruction.
+    mark_jump_targets();
+    thread_jumps();
+    if (!encode()) {
+        chunk.clear_code();
+        for (Byte byte : original) {
+            chunk.emit(byte);
+        }
+        chunk.lines() = std::move(original_lines);
+    }
+    code_.clear();
+}
+
+
+void Peephole::decode() {
+    std::span<const Byte> bytes{ chunk().bytes() };
+    // Jumps are decoded to offsets first, and resolved to indices at the end.
+    std::vector<size_t> index_of_offset(bytes.size() + 1, 0);
+
+    auto read_short = [&](size_t offset) {
+        return (size_t(bytes[offset]) << 8) | bytes[offset + 1];
+    };
+    auto read_long = [&](size_t offset) {
+        return (size_t(bytes[offset]) << 16) | (size_t(bytes[offset + 1]) << 8) | bytes[offset + 2];
+    };
+
+    code_.clear();
+    size_t offset{ 0 };
+    while (offset < bytes.size()) {
+        index_of_offset[offset] = code_.size();
+        Instruction instr{};
+        instr.op = OP{ bytes[offset] };
+        instr.location = chunk().lines().find(offset);
+        ++offset;
+        for (size_t arg{ 0 }; arg < num_args(instr.op); ++arg) {
+            instr.args[arg] = bytes[offset++];
+        }
+
+        if (has_byte_operand(instr.op)) {
+            instr.operand = bytes[offset++];
+        } else {
+            switch (instr.op) {
+                case OP::CONSTANT:
+                    instr.operand = bytes[offset++];
+                    break;
+                case OP::CONSTANT_LONG:
+                    // Either one is chosen by the index when encoding.
+                    instr.op = OP::CONSTANT;
+                    instr.operand = read_long(offset);
+                    offset += 3;
+                    break;
+                case OP::GET_GLOBAL_LONG:
+                case OP::SET_GLOBAL_LONG:
+                case OP::DEFINE_GLOBAL_LONG:
+                    // Same, by the slot.
+                    instr.op = short_global_op(instr.op);
+                    instr.operand = read_long(offset);
+                    offset += 3;
+                    break;
+                case OP::JUMP:
+                case OP::JUMP_IF_FALSE:
+                case OP::LESS_LOCAL_CONST_JUMP:
+                    instr.operand = offset + 2 + read_short(offset);
+                    offset += 2;
+                    break;
+                case OP::LOOP:
+                    instr.operand = offset + 2 - read_short(offset);
+                    offset += 2;
+                    break;
+                case OP::CLOSURE: {
+                        instr.operand = read_long(offset);
+                        offset += 3;
+                        const Value& function{ chunk().constants()[instr.operand] };
+                        size_t size{ 2 * function.as<const Function*>()->num_upvalues };
+                        instr.upvalues.assign(bytes.begin() + offset, bytes.begin() + offset + size);
+                        offset += size;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        code_.push_back(std::move(instr));
+    }
+    index_of_offset[bytes.size()] = code_.size();
+
+    for (Instruction& instr : code_) {
+        if (is_jump(instr.op)) {
+            instr.operand = index_of_offset[instr.operand];
+        }
+    }
+}
+
+
+bool Peephole::encode() {
+    chunk().clear_code();
+    // New offset of each instruction. The removed ones get the offset
+    // of the next remaining instruction, in case they were jumped to.
+    std::vector<size_t> new_offset(code_.size() + 1);
+    // Operand offset and the index of the jump instruction.
+    std::vector<std::pair<size_t, size_t>> jumps;
+
+    for (size_t i{ 0 }; i < code_.size(); ++i) {
+        new_offset[i] = chunk().size();
+        const Instruction& instr{ code_[i] };
+        if (instr.removed) {
+            continue;
+        }
+        if (instr.location) {
+            chunk().mark_location(*instr.location);
+        }
+        if (instr.op == OP::CONSTANT && instr.operand > UINT8_MAX) {
+            chunk().emit(OP::CONSTANT_LONG);
+            chunk().emit_long(instr.operand);
+            continue;
+        }
+        if (long_global_op(instr.op) != instr.op && instr.operand > UINT8_MAX) {
+            chunk().emit(long_global_op(instr.op));
+            chunk().emit_long(instr.operand);
+            continue;
+        }
+        chunk().emit(instr.op);
+        for (size_t arg{ 0 }; arg < num_args(instr.op); ++arg) {
+            chunk().emit(instr.args[arg]);
+        }
+        if (instr.op == OP::CONSTANT || has_byte_operand(instr.op)) {
+            chunk().emit(static_cast<Byte>(instr.operand));
+        } else if (is_jump(instr.op)) {
+            jumps.emplace_back(chunk().size(), i);
+            chunk().emit(Byte{ 0xff });
+            chunk().emit(Byte{ 0xff });
+        } else if (instr.op == OP::CLOSURE) {
+            chunk().emit_long(instr.operand);
+            for (Byte byte : instr.upvalues) {
+                chunk().emit(byte);
+            }
+        }
+    }
+    new_offset[code_.size()] = chunk().size();
+
+    // Dropping instructions only shortens the jumps, but threading one jump
+    // into another adds up their distances, which may no longer fit.
+    for (auto [operand_offset, i] : jumps) {
+        size_t from{ operand_offset + 2 };
+        size_t target{ new_offset[code_[i].operand] };
+        size_t jump{ code_[i].op == OP::LOOP ? from - target : target - from };
+        if (jump > UINT16_MAX) {
+            return false;
+        }
+        chunk().patch(operand_offset, static_cast<Byte>((jump >> 8) & 0xff));
+        chunk().patch(operand_offset + 1, static_cast<Byte>(jump & 0xff));
+    }
+    return true;
+}
+
+
+
+
+bool Peephole::fold_constants() {
+    bool changed{ false };
+    for (size_t i{ next_alive(0) }; i < code_.size(); i = next(i)) {
+        size_t j{ next(i) };
+        if (j == code_.size() || code_[j].is_jump_target || !is_constant(code_[i])) {
+            continue;
+        }
+        Value lhs{ constant_value(code_[i]) };
+
+        // Unary: [constant] NEGATE/NOT
+        if (code_[j].op == OP::NEGATE && lhs.is<Number>()) {
+            if (load_value(code_[i], Value{ -lhs.as<Number>() })) {
+                remove(j);
+                changed = true;
+            }
+            continue;
+        }
+        if (code_[j].op == OP::NOT) {
+            if (load_value(code_[i], Value{ !is_truthful(lhs) })) {
+                remove(j);
+                changed = true;
+            }
+            continue;
+        }
+
+        // Binary: [constant] [constant] OP
+        size_t k{ next(j) };
+        if (k == code_.size() || code_[k].is_jump_target || !is_constant(code_[j])) {
+            continue;
+        }
+        Value rhs{ constant_value(code_[j]) };
+        std::optional<Value> result;
+        switch (code_[k].op) {
+            case OP::EQUAL: result = Value{ lhs == rhs }; break;
+            case OP::NOT_EQUAL: result = Value{ !(lhs == rhs) }; break;
+            default: break;
+        }
+        if (lhs.is<Number>() && rhs.is<Number>()) {
+            Number a{ lhs.as<Number>() };
+            Number b{ rhs.as<Number>() };
+            switch (code_[k].op) {
+                case OP::ADD: result = Value{ a + b }; break;
+                case OP::SUBTRACT: result = Value{ a - b }; break;
+                case OP::MULTIPLY: result = Value{ a * b }; break;
+                case OP::DIVIDE: result = Value{ a / b }; break;
+                case OP::GREATER: result = Value{ a > b }; break;
+                case OP::LESS: result = Value{ a < b }; break;
+                default: break;
+            }
+        }
+        if (code_[k].op == OP::ADD && lhs.is<const String*>() && rhs.is<const String*>()) {
+            result = Value{ heap_.intern_string(*lhs.as<const String*>() + *rhs.as<const String*>()) };
+        }
+        if (result && load_value(code_[i], *result)) {
+            remove(j);
+            remove(k);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+bool Peephole::thread_jumps() {
+    bool changed{ false };
+    for (size_t i{ next_alive(0) }; i < code_.size(); i = next(i)) {
+        Instruction& instr{ code_[i] };
+        if (instr.op != OP::JUMP && instr.op != OP::JUMP_IF_FALSE) {
+            continue;
+        }
+        size_t target{ next_alive(instr.operand) };
+        // Bounded, in case of a cycle of jumps.
+        for (size_t hops{ 0 }; hops < 16; ++hops) {
+            if (target == code_.size() || code_[target].op != OP::JUMP) {
+                break;
+            }
+            target = next_alive(code_[target].operand);
+        }
+        if (target != next_alive(instr.operand)) {
+            instr.operand = target;
+            if (target < code_.size()) {
+                code_[target].is_jump_target = true;
+            }
+            changed = true;
+        }
+        // The condition is not popped either way.
+        if (target == next(i)) {
+            remove(i);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+bool Peephole::remove_dead_pushes() {
+    bool changed{ false };
+    for (size_t i{ next_alive(0) }; i < code_.size(); i = next(i)) {
+        size_t j{ next(i) };
+        if (j != code_.size() && is_pure_push(code_[i].op) &&
+            code_[j].op == OP::POP && !code_[j].is_jump_target)
+        {
+            remove(i);
+            remove(j);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+bool Peephole::fuse_pairs() {
+    bool changed{ false };
+    for (size_t i{ next_alive(0) }; i < code_.size(); i = next(i)) {
+        size_t j{ next(i) };
+        if (j == code_.size() || code_[j].is_jump_target) {
+            continue;
+        }
+        OP first{ code_[i].op };
+        OP second{ code_[j].op };
+        std::optional<OP> fused;
+        if (first == OP::EQUAL && second == OP::NOT) { fused = OP::NOT_EQUAL; }
+        if (first == OP::SET_LOCAL && second == OP::POP) { fused = OP::SET_LOCAL_POP; }
+        // There's no long form of the fused one.
+        if (first == OP::SET_GLOBAL && second == OP::POP && code_[i].operand <= UINT8_MAX) {
+            fused = OP::SET_GLOBAL_POP;
+        }
+        if (fused) {
+            code_[i].op = *fused;
+            remove(j);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+void Peephole::select_superinstructions() {
+    std::vector<size_t> num_jumps_to(code_.size() + 1, 0);
+    for (const Instruction& instr : code_) {
+        if (!instr.removed && is_jump(instr.op)) {
+            ++num_jumps_to[instr.operand];
+        }
+    }
+
+    for (size_t i{ next_alive(0) }; i < code_.size(); i = next(i)) {
+        Instruction& first{ code_[i] };
+        if (first.op != OP::GET_LOCAL) {
+            continue;
+        }
+        size_t j{ next(i) };
+        size_t k{ next(j) };
+        bool small_constant{ j < code_.size() && code_[j].op == OP::CONSTANT && code_[j].operand <= UINT8_MAX };
+
+        if (small_constant && matches(i, { OP::GET_LOCAL, OP::CONSTANT, OP::LESS, OP::JUMP_IF_FALSE, OP::POP })) {
+            size_t jump{ next(k) };
+            size_t target{ code_[jump].operand };
+            if (only_pops_condition(target, num_jumps_to)) {
+                first.op = OP::LESS_LOCAL_CONST_JUMP;
+                first.args = { static_cast<Byte>(first.operand), static_cast<Byte>(code_[j].operand) };
+                first.operand = target;
+                // Of the instruction that can fail.
+                first.location = code_[k].location;
+                remove(next(jump));
+                remove(jump);
+                remove(k);
+                remove(j);
+                // Whoever else lands here gets counted, before the next one is looked at.
+                num_jumps_to[next(target)] += num_jumps_to[target];
+                remove(target);
+                continue;
+            }
+        }
+        if (small_constant && (matches(i, { OP::GET_LOCAL, OP::CONSTANT, OP::ADD }) ||
+            matches(i, { OP::GET_LOCAL, OP::CONSTANT, OP::SUBTRACT })))
+        {
+            first.op = code_[k].op == OP::ADD ? OP::ADD_LOCAL_CONST : OP::SUBTRACT_LOCAL_CONST;
+            first.args = { static_cast<Byte>(first.operand) };
+            first.operand = code_[j].operand;
+            first.location = code_[k].location;
+            remove(k);
+            remove(j);
+            continue;
+        }
+        // Unless the second one starts a longer sequence.
+        if (matches(i, { OP::GET_LOCAL, OP::GET_LOCAL }) &&
+            (k == code_.size() || code_[k].op != OP::CONSTANT))
+        {
+            first.op = OP::GET_LOCAL2;
+            first.args = { static_cast<Byte>(first.operand) };
+            first.operand = code_[j].operand;
+            remove(j);
+        }
+    }
+}
+
+
+
+
+size_t Peephole::next(size_t idx) const noexcept {
+    return next_alive(idx + 1);
+}
+
+size_t Peephole::next_alive(size_t idx) const noexcept {
+    while (idx < code_.size() && code_[idx].removed) {
+        ++idx;
+    }
+    return idx;
+}
+
+size_t Peephole::prev(size_t idx) const noexcept {
+    while (idx > 0) {
+        --idx;
+        if (!code_[idx].removed) {
+            return idx;
+        }
+    }
+    return code_.size();
+}
+
+void Peephole::remove(size_t idx) noexcept {
+    code_[idx].removed = true;
+    // Whoever jumped here, now lands on the next one.
+    if (code_[idx].is_jump_target) {
+        size_t following{ next(idx) };
+        if (following < code_.size()) {
+            code_[following].is_jump_target = true;
+        }
+    }
+}
+
+void Peephole::mark_jump_targets() {
+    for (Instruction& instr : code_) {
+        instr.is_jump_target = false;
+    }
+    for (Instruction& instr : code_) {
+        if (!instr.removed && is_jump(instr.op)) {
+            instr.operand = next_alive(instr.operand);
+            if (instr.operand < code_.size()) {
+                code_[instr.operand].is_jump_target = true;
+            }
+        }
+    }
+}
+
+
+bool Peephole::matches(size_t idx, std::initializer_list<OP> ops) const noexcept {
+    bool is_first{ true };
+    for (OP op : ops) {
+        if (idx == code_.size() || code_[idx].op != op || (!is_first && code_[idx].is_jump_target)) {
+            return false;
+        }
+        is_first = false;
+        idx = next(idx);
+    }
+    return true;
+}
+
+bool Peephole::only_pops_condition(size_t target, const std::vector<size_t>& num_jumps_to) const noexcept {
+    if (target == code_.size() || code_[target].op != OP::POP || num_jumps_to[target] != 1) {
+        return false;
+    }
+    size_t before{ prev(target) };
+    return before != code_.size() && is_unconditional(code_[before].op);
+}
+
+
+bool Peephole::is_constant(const Instruction& instr) const noexcept {
+    switch (instr.op) {
+        case OP::CONSTANT:
+            // Not the functions, those are only loaded by CLOSURE anyway.
+            return true;
+        case OP::NIL:
+        case OP::TRUE:
+        case OP::FALSE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Value Peephole::constant_value(const Instruction& instr) const {
+    switch (instr.op) {
+        case OP::CONSTANT: return chunk().constants()[instr.operand];
+        case OP::TRUE: return Value{ true };
+        case OP::FALSE: return Value{ false };
+        default: return Value{ Nil{} };
+    }
+}
+
+bool Peephole::load_value(Instruction& instr, Value value) {
+    if (value.is<Nil>()) {
+        instr.op = OP::NIL;
+    } else if (value.is<Boolean>()) {
+        instr.op = value.as<Boolean>() ? OP::TRUE : OP::FALSE;
+    } else {
+        size_t index{ chunk().add_constant(value) };
+        if (index > Chunk::max_long_operand) {
+            return false;
+        }
+        instr.op = OP::CONSTANT;
+        instr.operand = index;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "Chunk.hpp"
+#include "OpCode.hpp"
+#include "SourceLocation.hpp"
+#include <array>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+
+class Heap;
+
+
+// Rewrites the bytecode of a chunk after the codegen, looking
+// at short sequences of instructions at a time:
+//   - folds arithmetic, comparisons, NEGATE and NOT of constants;
+//   - threads jumps to unconditional jumps, drops jumps to the next instruction;
+//   - drops pure pushes that are immediately popped;
+//   - fuses EQUAL NOT, SET_LOCAL POP and SET_GLOBAL POP;
+//   - finally, selects the superinstructions for the local variables.
+//
+// The code is decoded into a list of instructions, with the jumps
+// referring to their targets by index, and encoded back afterwards,
+// so that the jump offsets and the line table are rebuilt.
+// Only the first instruction of a rewritten sequence can be a jump target.
+class Peephole {
+private:
+    struct Instruction {
+        OP op;
+        // Constant index, slot or number of arguments.
+        // For jumps, the index of the target instruction.
+        size_t operand{ 0 };
+        // Of the superinstructions, the byte operands preceding the 'operand'.
+        std::array<Byte, 2> args{};
+        // The [is local] [index] pairs of CLOSURE.
+        std::vector<Byte> upvalues;
+        std::optional<SourceLocation> location;
+        bool is_jump_target{ false };
+        bool removed{ false };
+    };
+
+    Heap& heap_;
+    Chunk* chunk_{};
+    std::vector<Instruction> code_;
+
+public:
+    explicit Peephole(Heap& heap) : heap_{ heap } {}
+
+    // Not recursive, the chunks of the nested functions are optimized separately.
+    void optimize(Chunk& chunk);
+
+private:
+    void decode();
+    // Fails if a threaded jump got too far for it's 16-bit operand.
+    bool encode();
+
+    // Each returns true if anything changed.
+    bool fold_constants();
+    bool thread_jumps();
+    bool remove_dead_pushes();
+    bool fuse_pairs();
+    // After all of the above, since those don't know the superinstructions.
+    void select_superinstructions();
+
+    // Next instruction that has not been removed, or code_.size().
+    size_t next(size_t idx) const noexcept;
+    // Same, but starting from the 'idx' itself.
+    size_t next_alive(size_t idx) const noexcept;
+    // Previous instruction that has not been removed, or code_.size() if none.
+    size_t prev(size_t idx) const noexcept;
+    void remove(size_t idx) noexcept;
+    void mark_jump_targets();
+    // The instructions starting from the 'idx' have the 'ops',
+    // and none but the first one is a jump target.
+    bool matches(size_t idx, std::initializer_list<OP> ops) const noexcept;
+    // The 'target' of a conditional jump only pops the condition,
+    // and can be dropped along with the push of the condition.
+    bool only_pops_condition(size_t target, const std::vector<size_t>& num_jumps_to) const noexcept;
+
+    bool is_constant(const Instruction& instr) const noexcept;
+    Value constant_value(const Instruction& instr) const;
+    // Replaces the instruction with the load of the 'value'.
+    // Fails if there's no room for another constant.
+    bool load_value(Instruction& instr, Value value);
+
+    Chunk& chunk() const noexcept { return *chunk_; }
+};
@@ -7,9 +7,18 @@
 #include "IError.hpp"
 #include "VM.hpp"
 #include "CodegenVisitor.hpp"
+#include "Builtins.hpp"
+#include "BytecodeCache.hpp"
+#include "Peephole.hpp"
+#include "StackDepth.hpp"
+#include "OpProfiler.hpp"
 #include <fmt/core.h>
+#include <iostream>
 #include <optional>
 #include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
 
 
 
@@ -20,8 +29,18 @@ private:
 
     Frontend frontend_;
     VM vm_;
+    // Reported to stderr at the end.
+    std::optional<OpProfiler> profiler_;
 
     bool debug_bytecode;
+    bool use_cache;
+    int opt_level;
+
+    // Set in the file mode, when the cache is used.
+    std::optional<std::filesystem::path> cache_path_;
+    // Keeps the bytecode of the cached program mapped while it runs.
+    std::optional<MappedFile> cache_file_;
+    size_t num_builtins_;
 
 public:
     RunContext(
@@ -30,11 +49,19 @@ public:
     ) :
         ErrorSender{ err },
         filename_{ config.filename },
-        frontend_{ err, { config.debug_scanner, config.debug_parser } },
-        vm_{ /* err */ },
-        debug_bytecode{ config.debug_bytecode }
+        frontend_{ err, { config.debug_scanner, config.debug_parser, config.opt_level > 0 } },
+        vm_{ err },
+        debug_bytecode{ config.debug_bytecode },
+        // The debug output of the frontend needs the frontend to run.
+        use_cache{ !config.no_cache && !config.debug_scanner && !config.debug_parser },
+        opt_level{ config.opt_level }
     {
-        /* setup builtins */
+        setup_builtins(vm_, frontend_.resolver());
+        num_builtins_ = frontend_.resolver().num_global_slots();
+        if (config.profile_opcodes) {
+            profiler_.emplace(config.profile_cycles);
+            vm_.set_profiler(&profiler_.value());
+        }
     }
 
 
@@ -44,6 +71,9 @@ public:
         } else {
             run_file();
         }
+        if (profiler_) {
+            std::cerr << profiler_->report();
+        }
     }
 
     Frontend& frontend() noexcept { return frontend_; }
@@ -89,7 +119,7 @@ public:
 
         std::cout << "> ";
         while (std::getline(std::cin, line)) {
-            run(line);
+            run(frontend().sources().add(std::move(line)));
             std::cout << "> ";
         }
         std::cout << std::endl;
@@ -100,8 +130,14 @@ public:
     void run_file() {
         // filename_ is guaranteed to have value if called from start_running()
         assert(filename_);
-        auto text = Importer::read_file(filename_.value());
+        auto text = frontend().sources().read(filename_.value());
         if (text) {
+            if (use_cache) {
+                cache_path_ = bytecode_cache_path(std::filesystem::canonical(filename_.value()));
+                if (run_cached(text.value())) {
+                    return;
+                }
+            }
             // The data flow here is awkward, tbh
             run(text.value());
         } else {
@@ -116,7 +152,8 @@ public:
     }
 
 
-    void run(const std::string& text) {
+    // The 'text' must be retained by the sources() of the Frontend.
+    void run(std::string_view text) {
 
         auto new_stmts = frontend().pass(text, filename_);
 
@@ -125,18 +162,34 @@ public:
         }
 
         Chunk chunk;
-        CodegenVisitor codegen{ error_reporter(), chunk };
+        CodegenVisitor codegen{ error_reporter(), vm_.heap(), chunk, opt_level };
 
         for (const auto& stmt : new_stmts) {
             stmt->accept(codegen);
         }
         chunk.emit(OP::RETURN);
 
+        if (opt_level > 0) {
+            Peephole{ vm_.heap() }.optimize(chunk);
+        }
+        chunk.set_max_stack(max_stack_depth(chunk, 0).value_or(0));
+
         if (is_debug_bytecode_mode()) {
             Disassembler diss;
             std::cout << diss.disassemble("chunk", chunk);
         }
 
+        if (error_reporter().had_errors()) {
+            frontend().importer().undo_last_successful_pass();
+            return;
+        }
+
+        vm_.resize_globals(frontend().resolver().num_global_slots());
+
+        if (cache_path_) {
+            store_cache(text, chunk);
+        }
+
         if (!vm_.interpret(chunk)) {
             // Ehhh, there's no state yet really,
             // But will have to be done later on.
@@ -146,5 +199,47 @@ public:
 
 
 
+    // Runs the program from the cache, if it's up-to-date.
+    bool run_cached(std::string_view text) {
+        cache_file_ = MappedFile::open(cache_path_.value());
+        if (!cache_file_) {
+            return false;
+        }
+
+        auto program = load_bytecode_cache(*cache_file_, text, num_builtins_, opt_level, vm_.heap());
+        if (!program) {
+            cache_file_.reset();
+            return false;
+        }
+
+        if (is_debug_bytecode_mode()) {
+            Disassembler diss;
+            std::cout << diss.disassemble("chunk", program->chunk);
+        }
+
+        vm_.resize_globals(program->num_globals);
+        vm_.interpret(program->chunk);
+        return true;
+    }
+
+    // Failing to write the cache is not an error, it's just slower next time.
+    void store_cache(std::string_view text, const Chunk& chunk) {
+        // The first one is the top-level file itself. The rest are relative
+        // to it's directory, which is the current directory after the frontend pass.
+        std::vector<std::filesystem::path> imports;
+        const auto& imported = frontend().importer().imported_files();
+        for (size_t i{ 1 }; i < imported.size(); ++i) {
+            std::error_code ec;
+            imports.emplace_back(std::filesystem::canonical(imported[i], ec));
+            if (ec) {
+                return;
+            }
+        }
+        store_bytecode_cache(
+            cache_path_.value(), text, imports, num_builtins_, opt_level,
+            frontend().resolver().num_global_slots(), chunk
+        );
+    }
+
 };
 
@@ -0,0 +1,187 @@
+#include "StackDepth.hpp"
+
+#include "Object.hpp"
+#include <algorithm>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+
+namespace {
+
+using depth_t = std::ptrdiff_t;
+
+// The depth of the instructions not reached yet.
+constexpr depth_t unknown{ -1 };
+
+struct StackEffect {
+    // Values the instruction needs on the stack.
+    depth_t pops;
+    depth_t pushes;
+    // Above the depth after the instruction, in the middle of it.
+    depth_t extra{ 0 };
+};
+
+// The 'operand' is the byte right after the opcode.
+StackEffect stack_effect(OP op, Byte operand) noexcept {
+    switch (op) {
+        case OP::CONSTANT:
+        case OP::CONSTANT_LONG:
+        case OP::NIL:
+        case OP::TRUE:
+        case OP::FALSE:
+        case OP::GET_GLOBAL:
+        case OP::GET_GLOBAL_LONG:
+        case OP::GET_LOCAL:
+        case OP::CLOSURE:
+        case OP::GET_UPVALUE:
+        case OP::SUBTRACT_LOCAL_CONST:
+            return { 0, 1 };
+        case OP::ADD_LOCAL_CONST:
+            // Pushes both operands for the string concatenation.
+            return { 0, 1, 1 };
+        case OP::GET_LOCAL2:
+            return { 0, 2 };
+        case OP::POP:
+        case OP::DEFINE_GLOBAL:
+        case OP::DEFINE_GLOBAL_LONG:
+        case OP::PRINT:
+        case OP::CLOSE_UPVALUE:
+        case OP::SET_LOCAL_POP:
+        case OP::SET_GLOBAL_POP:
+            return { 1, 0 };
+        case OP::SET_GLOBAL:
+        case OP::SET_GLOBAL_LONG:
+        case OP::SET_LOCAL:
+        case OP::NEGATE:
+        case OP::NOT:
+        case OP::JUMP_IF_FALSE:
+        case OP::SET_UPVALUE:
+            return { 1, 1 };
+        case OP::EQUAL:
+        case OP::GREATER:
+        case OP::LESS:
+        case OP::ADD:
+        case OP::SUBTRACT:
+        case OP::MULTIPLY:
+        case OP::DIVIDE:
+        case OP::NOT_EQUAL:
+            return { 2, 1 };
+        case OP::CALL:
+            // The callee and the arguments are replaced by the result.
+            return { depth_t{ operand } + 1, 1 };
+        default:
+            // RETURN pops the result, but it's the last one anyway.
+            return { 0, 0 };
+    }
+}
+
+size_t read_short(std::span<const Byte> bytes, size_t offset) noexcept {
+    return (size_t(bytes[offset]) << 8) | bytes[offset + 1];
+}
+
+size_t read_long(std::span<const Byte> bytes, size_t offset) noexcept {
+    return (size_t(bytes[offset]) << 16) | (size_t(bytes[offset + 1]) << 8) | bytes[offset + 2];
+}
+
+// The local slots the instruction at the 'offset' refers to are all below the 'depth'.
+bool has_locals_below(const Chunk& chunk, size_t offset, depth_t depth) {
+    std::span<const Byte> bytes{ chunk.bytes() };
+    auto below = [depth](size_t slot) { return depth_t(slot) < depth; };
+    switch (OP{ bytes[offset] }) {
+        case OP::GET_LOCAL:
+        case OP::ADD_LOCAL_CONST:
+        case OP::SUBTRACT_LOCAL_CONST:
+        case OP::LESS_LOCAL_CONST_JUMP:
+            return below(bytes[offset + 1]);
+        case OP::SET_LOCAL:
+        case OP::SET_LOCAL_POP:
+            // Not the value being assigned.
+            return below(size_t(bytes[offset + 1]) + 1);
+        case OP::GET_LOCAL2:
+            return below(bytes[offset + 1]) && below(bytes[offset + 2]);
+        case OP::CLOSURE: {
+                const Value& function{ chunk.constants()[read_long(bytes, offset + 1)] };
+                size_t num_upvalues{ function.as<const Function*>()->num_upvalues };
+                for (size_t i{ 0 }; i < num_upvalues; ++i) {
+                    bool is_local{ bytes[offset + 4 + 2 * i] != 0 };
+                    if (is_local && !below(bytes[offset + 5 + 2 * i])) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        default:
+            return true;
+    }
+}
+
+size_t instruction_size(const Chunk& chunk, size_t offset) {
+    std::span<const Byte> bytes{ chunk.bytes() };
+    OP op{ bytes[offset] };
+    size_t size{ 1 + operand_size(op) };
+    if (op == OP::CLOSURE) {
+        const Value& function{ chunk.constants()[read_long(bytes, offset + 1)] };
+        size += 2 * function.as<const Function*>()->num_upvalues;
+    }
+    return size;
+}
+
+} // namespace
+
+
+
+std::optional<size_t> max_stack_depth(const Chunk& chunk, size_t entry_depth) {
+    std::span<const Byte> bytes{ chunk.bytes() };
+    std::vector<depth_t> depth_at(bytes.size(), unknown);
+    // The jump targets still to be walked, with the depth there.
+    std::vector<std::pair<size_t, depth_t>> pending{ { 0, depth_t(entry_depth) } };
+    depth_t max_depth{ depth_t(entry_depth) };
+
+    // Each path is walked until it reaches an instruction already seen.
+    while (!pending.empty()) {
+        auto [offset, depth] = pending.back();
+        pending.pop_back();
+        while (true) {
+            if (offset >= bytes.size()) {
+                return std::nullopt;
+            }
+            if (depth_at[offset] != unknown) {
+                if (depth_at[offset] != depth) {
+                    return std::nullopt;
+                }
+                break;
+            }
+            depth_at[offset] = depth;
+
+            OP op{ bytes[offset] };
+            size_t next{ offset + instruction_size(chunk, offset) };
+            StackEffect effect{ stack_effect(op, next - offset > 1 ? bytes[offset + 1] : Byte{ 0 }) };
+            if (depth < effect.pops || !has_locals_below(chunk, offset, depth)) {
+                return std::nullopt;
+            }
+            depth += effect.pushes - effect.pops;
+            max_depth = std::max(max_depth, depth + effect.extra);
+
+            if (op == OP::RETURN) {
+                break;
+            }
+            if (op == OP::JUMP || op == OP::JUMP_IF_FALSE || op == OP::LESS_LOCAL_CONST_JUMP) {
+                pending.emplace_back(next + read_short(bytes, next - 2), depth);
+            }
+            if (op == OP::LOOP) {
+                size_t back{ read_short(bytes, next - 2) };
+                if (back > next) {
+                    return std::nullopt;
+                }
+                pending.emplace_back(next - back, depth);
+            }
+            if (op == OP::JUMP || op == OP::LOOP) {
+                break;
+            }
+            offset = next;
+        }
+    }
+    return size_t(max_depth) - entry_depth;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "Chunk.hpp"
+#include <optional>
+#include <cstddef>
+
+
+// The most values the code of the 'chunk' has on the stack at once,
+// above the 'entry_depth' ones already there when it starts: the callee
+// and the arguments for a function, none for the top-level code.
+// For the VM to check the room once per frame, instead of on every push.
+//
+// Follows both paths of the jumps. Empty if the depth at an instruction
+// depends on the path taken to it, an instruction pops more than there is,
+// or refers to a local above the top of the stack. The codegen never emits
+// any of those, the cached code is checked with it, see verify_chunk().
+//
+// Otherwise trusts the instructions to be well-formed.
+std::optional<size_t> max_stack_depth(const Chunk& chunk, size_t entry_depth);
@@ -1,75 +1,470 @@
 #pragma once
 #include "Chunk.hpp"
 #include "Constants.hpp"
+#include "ErrorReporter.hpp"
+#include "ErrorSender.hpp"
+#include "IError.hpp"
+#include "Object.hpp"
 #include "OpCode.hpp"
+#include "OpProfiler.hpp"
 #include "Utils.hpp"
 #include "ValueStack.hpp"
 #include <fmt/core.h>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <string_view>
 #include <type_traits>
+#include <vector>
 
-class VM {
+class VM : private ErrorSender<SimpleError> {
 private:
-    using ip_t = std::vector<Byte>::const_iterator;
+    using ip_t = const Byte*;
 
+    // The state of the caller, saved when calling into a function.
+    struct CallFrame {
+        const Closure* closure;
+        const Chunk* chunk;
+        ip_t ip;
+        size_t base;
+    };
+
+    static constexpr size_t max_call_depth{ 1024 };
+    // Each frame checks for the max_stack() of it's chunk on entry,
+    // the pushes themselves don't.
+    static constexpr size_t max_stack_slots{ 64 * 1024 };
+
+    // The currently executing frame is kept out of the frames_,
+    // in the closure_, chunk_, ip_ and base_. The base is the index of the slot 0
+    // of the frame in the stack_: the callee, followed by the arguments.
+    // The top-level code has no closure.
+    const Closure* closure_{};
     const Chunk* chunk_{};
     ip_t ip_;
-    Constants constants_;
-    ValueStack stack_;
+    size_t base_{ 0 };
+    std::vector<CallFrame> frames_;
+
+    ValueStack stack_{ max_stack_slots };
+    // Upvalues that still refer to the variables on the stack,
+    // sorted by the stack slot. Shared by all closures capturing the same variable.
+    std::vector<Upvalue*> open_upvalues_;
+    // Indexed by the slots assigned by the Resolver.
+    // Persist between the calls to interpret() in the prompt mode.
+    std::vector<Value> globals_;
+    Heap heap_;
+    // Only consulted when built with LOX_VM_PROFILING.
+    OpProfiler* profiler_{};
 
 public:
+    VM(ErrorReporter& err) : ErrorSender{ err } {}
+
     bool interpret(const Chunk& chunk) {
+        if (!stack_.has_room(chunk.max_stack())) {
+            send_error("[Error @VM]: Stack overflow.\n");
+            return false;
+        }
+        closure_ = nullptr;
         chunk_ = &chunk;
         ip_ = chunk.begin();
-        return run();
+        base_ = 0;
+        bool ok{ run() };
+        if (profiler_) {
+            profiler_->finish();
+        }
+        if (!ok) {
+            frames_.clear();
+            stack_.clear();
+            open_upvalues_.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Only grows. New globals are initialized to nil.
+    void resize_globals(size_t num_globals) {
+        if (num_globals > globals_.size()) {
+            globals_.resize(num_globals);
+        }
+    }
+
+    void define_global(size_t slot, Value value) {
+        resize_globals(slot + 1);
+        globals_[slot] = value;
     }
 
+    Heap& heap() noexcept { return heap_; }
+
+    // Null to stop profiling.
+    void set_profiler(OpProfiler* profiler) noexcept { profiler_ = profiler; }
+
 
 private:
+    // Dispatch either through a table of label addresses (labels-as-values,
+    // a GCC/Clang extension), jumping to the next handler directly from the end
+    // of the previous one, or through a portable switch in a loop.
+    // Selected with the LOX_VM_COMPUTED_GOTO option.
+    //
+    // With the LOX_VM_PROFILING option every opcode is also shown to the profiler,
+    // otherwise the dispatch is not touched at all.
+#ifdef LOX_PROFILE
+    #define VM_READ_OP() profile_op(read_byte())
+#else
+    #define VM_READ_OP() read_byte()
+#endif
+
+#ifdef LOX_COMPUTED_GOTO
+    #define VM_DISPATCH() goto *dispatch_table[VM_READ_OP()];
+    #define VM_CASE(opcode) op_##opcode
+    #define VM_NEXT() goto *dispatch_table[VM_READ_OP()]
+#else
+    #define VM_DISPATCH() switch (OP{ VM_READ_OP() })
+    #define VM_CASE(opcode) case OP::opcode
+    #define VM_NEXT() continue
+#endif
+
     bool run() {
+#ifdef LOX_COMPUTED_GOTO
+        // Must list the handlers in the order of the OP enum.
+        static void* const dispatch_table[]{
+            &&op_RETURN, &&op_CONSTANT, &&op_CONSTANT_LONG, &&op_NIL, &&op_TRUE, &&op_FALSE, &&op_POP,
+            &&op_GET_GLOBAL, &&op_SET_GLOBAL, &&op_DEFINE_GLOBAL,
+            &&op_GET_GLOBAL_LONG, &&op_SET_GLOBAL_LONG, &&op_DEFINE_GLOBAL_LONG,
+            &&op_GET_LOCAL, &&op_SET_LOCAL,
+            &&op_EQUAL, &&op_GREATER, &&op_LESS, &&op_NEGATE, &&op_NOT,
+            &&op_ADD, &&op_SUBTRACT, &&op_MULTIPLY, &&op_DIVIDE,
+            &&op_PRINT, &&op_JUMP, &&op_JUMP_IF_FALSE, &&op_LOOP,
+            &&op_CALL, &&op_CLOSURE,
+            &&op_GET_UPVALUE, &&op_SET_UPVALUE, &&op_CLOSE_UPVALUE,
+            &&op_NOT_EQUAL, &&op_SET_LOCAL_POP, &&op_SET_GLOBAL_POP,
+            &&op_GET_LOCAL2, &&op_ADD_LOCAL_CONST, &&op_SUBTRACT_LOCAL_CONST,
+            &&op_LESS_LOCAL_CONST_JUMP,
+        };
+        static_assert(std::size(dispatch_table) == num_opcodes);
+#endif
         while (true) {
-            Byte instruction{ read_byte() };
-            switch (OP{ instruction }) {
-                case OP::RETURN:
-                    return true;
-                case OP::CONSTANT:
+            VM_DISPATCH() {
+                VM_CASE(RETURN):
+                    // The top-level code returns nothing.
+                    if (frames_.empty()) {
+                        return true;
+                    }
+                    return_from_call();
+                    VM_NEXT();
+                VM_CASE(CONSTANT):
                     stack_.push(read_constant());
-                    break;
-                case OP::NEGATE:
-                    stack_.back() = -stack_.back();
-                    break;
-                case OP::ADD: binary_op(OP::ADD); break;
-                case OP::SUBTRACT: binary_op(OP::SUBTRACT); break;
-                case OP::MULTIPLY: binary_op(OP::MULTIPLY); break;
-                case OP::DIVIDE: binary_op(OP::DIVIDE); break;
-                case OP::PRINT:
+                    VM_NEXT();
+                VM_CASE(CONSTANT_LONG):
+                    stack_.push(read_constant_long());
+                    VM_NEXT();
+                VM_CASE(NIL): stack_.push(Value{ Nil{} }); VM_NEXT();
+                VM_CASE(TRUE): stack_.push(Value{ true }); VM_NEXT();
+                VM_CASE(FALSE): stack_.push(Value{ false }); VM_NEXT();
+                VM_CASE(POP):
+                    stack_.pop();
+                    VM_NEXT();
+                VM_CASE(GET_GLOBAL):
+                    stack_.push(globals_[read_byte()]);
+                    VM_NEXT();
+                VM_CASE(SET_GLOBAL):
+                    // Assignment is an expression, leave the value on the stack.
+                    globals_[read_byte()] = stack_.back();
+                    VM_NEXT();
+                VM_CASE(DEFINE_GLOBAL):
+                    globals_[read_byte()] = stack_.pop();
+                    VM_NEXT();
+                VM_CASE(GET_GLOBAL_LONG):
+                    stack_.push(globals_[read_long()]);
+                    VM_NEXT();
+                VM_CASE(SET_GLOBAL_LONG):
+                    globals_[read_long()] = stack_.back();
+                    VM_NEXT();
+                VM_CASE(DEFINE_GLOBAL_LONG):
+                    globals_[read_long()] = stack_.pop();
+                    VM_NEXT();
+                VM_CASE(GET_LOCAL):
+                    stack_.push(stack_[base_ + read_byte()]);
+                    VM_NEXT();
+                VM_CASE(SET_LOCAL):
+                    stack_[base_ + read_byte()] = stack_.back();
+                    VM_NEXT();
+                VM_CASE(EQUAL): {
+                        Value rhs = stack_.pop();
+                        stack_.back() = Value{ stack_.back() == rhs };
+                    }
+                    VM_NEXT();
+                VM_CASE(GREATER):
+                    if (!numeric_op(std::greater<>{})) { return false; }
+                    VM_NEXT();
+                VM_CASE(LESS):
+                    if (!numeric_op(std::less<>{})) { return false; }
+                    VM_NEXT();
+                VM_CASE(NEGATE):
+                    if (!stack_.back().is<Number>()) {
+                        return runtime_error("Operand must be a number");
+                    }
+                    stack_.back() = Value{ -stack_.back().as<Number>() };
+                    VM_NEXT();
+                VM_CASE(NOT):
+                    stack_.back() = Value{ !is_truthful(stack_.back()) };
+                    VM_NEXT();
+                VM_CASE(ADD):
+                    if (!add_op()) { return false; }
+                    VM_NEXT();
+                VM_CASE(SUBTRACT):
+                    if (!numeric_op(std::minus<>{})) { return false; }
+                    VM_NEXT();
+                VM_CASE(MULTIPLY):
+                    if (!numeric_op(std::multiplies<>{})) { return false; }
+                    VM_NEXT();
+                VM_CASE(DIVIDE):
+                    if (!numeric_op(std::divides<>{})) { return false; }
+                    VM_NEXT();
+                VM_CASE(PRINT):
                     fmt::print("{}\n", to_string(stack_.pop()));
-                    break;
+                    VM_NEXT();
+                VM_CASE(JUMP):
+                    ip_ += read_short();
+                    VM_NEXT();
+                VM_CASE(JUMP_IF_FALSE): {
+                        uint16_t offset{ read_short() };
+                        if (!is_truthful(stack_.back())) {
+                            ip_ += offset;
+                        }
+                    }
+                    VM_NEXT();
+                VM_CASE(LOOP):
+                    ip_ -= read_short();
+                    VM_NEXT();
+                VM_CASE(CALL):
+                    if (!call_value(read_byte())) {
+                        return false;
+                    }
+                    VM_NEXT();
+                VM_CASE(CLOSURE):
+                    make_closure();
+                    VM_NEXT();
+                VM_CASE(GET_UPVALUE):
+                    stack_.push(upvalue_value(*closure_->upvalues[read_byte()]));
+                    VM_NEXT();
+                VM_CASE(SET_UPVALUE):
+                    upvalue_value(*closure_->upvalues[read_byte()]) = stack_.back();
+                    VM_NEXT();
+                VM_CASE(CLOSE_UPVALUE):
+                    close_upvalues(stack_.size() - 1);
+                    stack_.pop();
+                    VM_NEXT();
+                VM_CASE(NOT_EQUAL): {
+                        Value rhs = stack_.pop();
+                        stack_.back() = Value{ !(stack_.back() == rhs) };
+                    }
+                    VM_NEXT();
+                VM_CASE(SET_LOCAL_POP):
+                    stack_[base_ + read_byte()] = stack_.pop();
+                    VM_NEXT();
+                VM_CASE(SET_GLOBAL_POP):
+                    globals_[read_byte()] = stack_.pop();
+                    VM_NEXT();
+                VM_CASE(GET_LOCAL2): {
+                        Byte first{ read_byte() };
+                        Byte second{ read_byte() };
+                        stack_.push(stack_[base_ + first]);
+                        stack_.push(stack_[base_ + second]);
+                    }
+                    VM_NEXT();
+                VM_CASE(ADD_LOCAL_CONST): {
+                        const Value& lhs{ stack_[base_ + read_byte()] };
+                        const Value& rhs{ read_constant() };
+                        if (lhs.is<Number>() && rhs.is<Number>()) {
+                            stack_.push(Value{ lhs.as<Number>() + rhs.as<Number>() });
+                            VM_NEXT();
+                        }
+                        // Strings, or an error.
+                        stack_.push(lhs);
+                        stack_.push(rhs);
+                        if (!add_op()) { return false; }
+                    }
+                    VM_NEXT();
+                VM_CASE(SUBTRACT_LOCAL_CONST): {
+                        const Value& lhs{ stack_[base_ + read_byte()] };
+                        const Value& rhs{ read_constant() };
+                        if (!lhs.is<Number>() || !rhs.is<Number>()) {
+                            return runtime_error("Operands must be numbers");
+                        }
+                        stack_.push(Value{ lhs.as<Number>() - rhs.as<Number>() });
+                    }
+                    VM_NEXT();
+                VM_CASE(LESS_LOCAL_CONST_JUMP): {
+                        const Value& lhs{ stack_[base_ + read_byte()] };
+                        const Value& rhs{ read_constant() };
+                        uint16_t offset{ read_short() };
+                        if (!lhs.is<Number>() || !rhs.is<Number>()) {
+                            return runtime_error("Operands must be numbers");
+                        }
+                        if (!(lhs.as<Number>() < rhs.as<Number>())) {
+                            ip_ += offset;
+                        }
+                    }
+                    VM_NEXT();
+#ifndef LOX_COMPUTED_GOTO
                 default:
                     return false;
+#endif
             }
         }
     }
 
-    void binary_op(OP opcode) {
-        Value lhs = stack_.pop();
-        Value rhs = stack_.pop();
-        switch (opcode) {
-            case OP::ADD:
-                stack_.push(lhs + rhs);
-                break;
-            case OP::SUBTRACT:
-                stack_.push(lhs - rhs);
-                break;
-            case OP::MULTIPLY:
-                stack_.push(lhs * rhs);
-                break;
-            case OP::DIVIDE:
-                stack_.push(lhs / rhs);
-                break;
-            default:
-                assert(false && "Unknown binary op");
-                break;
+#undef VM_READ_OP
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef VM_NEXT
+
+#ifdef LOX_PROFILE
+    Byte profile_op(Byte op) noexcept {
+        if (profiler_) {
+            profiler_->record(OP{ op });
+        }
+        return op;
+    }
+#endif
+
+    // Pops the operands, pushes the result of 'op' in place of them.
+    template<typename BinaryOp>
+    bool numeric_op(BinaryOp op) {
+        Value& lhs{ stack_.peek(1) };
+        const Value& rhs{ stack_.peek(0) };
+        if (!lhs.is<Number>() || !rhs.is<Number>()) {
+            return runtime_error("Operands must be numbers");
+        }
+        lhs = Value{ op(lhs.as<Number>(), rhs.as<Number>()) };
+        stack_.pop();
+        return true;
+    }
+
+    bool add_op() {
+        if (stack_.peek(0).is<const String*>() && stack_.peek(1).is<const String*>()) {
+            const String* rhs = stack_.pop().as<const String*>();
+            const String* lhs = stack_.pop().as<const String*>();
+            stack_.push(Value{ heap_.make_string(*lhs + *rhs) });
+            return true;
+        }
+        if (!stack_.peek(0).is<Number>() || !stack_.peek(1).is<Number>()) {
+            return runtime_error("Operands must be two numbers or two strings");
         }
+        return numeric_op(std::plus<>{});
+    }
+
+    bool call_value(size_t num_args) {
+        Value callee{ stack_.peek(num_args) };
+
+        if (callee.is<const Closure*>()) {
+            const Closure* closure{ callee.as<const Closure*>() };
+            const Function* function{ closure->function };
+            if (!check_arity(function->arity, num_args)) {
+                return false;
+            }
+            if (frames_.size() == max_call_depth || !stack_.has_room(function->chunk.max_stack())) {
+                return runtime_error("Stack overflow");
+            }
+            frames_.push_back({ closure_, chunk_, ip_, base_ });
+            closure_ = closure;
+            chunk_ = &function->chunk;
+            ip_ = chunk_->begin();
+            base_ = stack_.size() - num_args - 1;
+            return true;
+        }
+
+        if (callee.is<const NativeFunction*>()) {
+            const NativeFunction* native{ callee.as<const NativeFunction*>() };
+            if (!check_arity(native->arity, num_args)) {
+                return false;
+            }
+            Value result{ native->fun(stack_.top(num_args)) };
+            stack_.shrink(stack_.size() - num_args - 1);
+            stack_.push(std::move(result));
+            return true;
+        }
+
+        return runtime_error(
+            fmt::format("Can only call functions, encountered {}", type_name(callee))
+        );
+    }
+
+    bool check_arity(size_t arity, size_t num_args) {
+        if (arity != num_args) {
+            return runtime_error(
+                fmt::format("Expected {} arguments, got {}", arity, num_args)
+            );
+        }
+        return true;
+    }
+
+    void return_from_call() {
+        Value result{ stack_.pop() };
+        close_upvalues(base_);
+        stack_.shrink(base_);
+        stack_.push(std::move(result));
+
+        const CallFrame& caller{ frames_.back() };
+        closure_ = caller.closure;
+        chunk_ = caller.chunk;
+        ip_ = caller.ip;
+        base_ = caller.base;
+        frames_.pop_back();
+    }
+
+    void make_closure() {
+        const Function* function{ read_constant_long().as<const Function*>() };
+        Closure* closure{ heap_.make_closure(function) };
+        closure->upvalues.reserve(function->num_upvalues);
+        for (size_t i{ 0 }; i < function->num_upvalues; ++i) {
+            bool is_local{ read_byte() != 0 };
+            Byte index{ read_byte() };
+            closure->upvalues.push_back(
+                is_local ? capture_upvalue(base_ + index) : closure_->upvalues[index]
+            );
+        }
+        stack_.push(Value{ static_cast<const Closure*>(closure) });
+    }
+
+    // Reuses the open upvalue, if the variable is already captured.
+    Upvalue* capture_upvalue(size_t slot) {
+        auto it = std::lower_bound(
+            open_upvalues_.begin(), open_upvalues_.end(), slot,
+            [](const Upvalue* upvalue, size_t slot) { return upvalue->slot < slot; }
+        );
+        if (it != open_upvalues_.end() && (*it)->slot == slot) {
+            return *it;
+        }
+        return *open_upvalues_.insert(it, heap_.make_upvalue(slot));
+    }
+
+    // Closes the upvalues of all variables at the 'from_slot' and above.
+    void close_upvalues(size_t from_slot) {
+        while (!open_upvalues_.empty() && open_upvalues_.back()->slot >= from_slot) {
+            Upvalue& upvalue{ *open_upvalues_.back() };
+            upvalue.closed = stack_[upvalue.slot];
+            upvalue.is_open = false;
+            open_upvalues_.pop_back();
+        }
+    }
+
+    Value& upvalue_value(Upvalue& upvalue) noexcept {
+        return upvalue.is_open ? stack_[upvalue.slot] : upvalue.closed;
+    }
+
+    // Always returns false, for convenience.
+    bool runtime_error(std::string_view msg) {
+        // The instruction has been at least partially read,
+        // the last read byte belongs to it.
+        auto location = chunk_->lines().find(size_t(ip_ - chunk_->begin()) - 1);
+        if (location) {
+            send_error(fmt::format(
+                "[Error @VM] at {:s}:\n{}.\n", detail::location_info(*location), msg
+            ));
+        } else {
+            send_error(fmt::format("[Error @VM]: {}.\n", msg));
+        }
+        return false;
     }
 
 
@@ -78,10 +473,28 @@ private:
         return *ip_++;
     }
 
+    [[nodiscard]]
+    uint16_t read_short() noexcept {
+        ip_ += 2;
+        return static_cast<uint16_t>((ip_[-2] << 8) | ip_[-1]);
+    }
+
     [[nodiscard]]
     const Value& read_constant() noexcept {
         return chunk_->constants()[*ip_++];
     }
 
+    // 24-bit, big-endian.
+    [[nodiscard]]
+    size_t read_long() noexcept {
+        ip_ += 3;
+        return (size_t(ip_[-3]) << 16) | (size_t(ip_[-2]) << 8) | ip_[-1];
+    }
+
+    [[nodiscard]]
+    const Value& read_constant_long() noexcept {
+        return chunk_->constants()[read_long()];
+    }
+
 
 };
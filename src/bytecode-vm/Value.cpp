@@ -0,0 +1,54 @@
+#include "Value.hpp"
+#include "Object.hpp"
+#include <fmt/format.h>
+
+
+
+bool Value::operator==(const Value& other) const noexcept {
+    if (is<const String*>() && other.is<const String*>()) {
+        return *as<const String*>() == *other.as<const String*>();
+    }
+#ifdef LOX_NAN_BOXING
+    // NaN != NaN and 0.0 == -0.0, bitwise comparison is not enough.
+    if (is<Number>() && other.is<Number>()) {
+        return as<Number>() == other.as<Number>();
+    }
+    return bits_ == other.bits_;
+#else
+    return value_ == other.value_;
+#endif
+}
+
+
+std::string to_string(const Value& value) {
+    if (value.is<Number>()) {
+        return std::string(num_to_string(value.as<Number>()));
+    }
+    if (value.is<Boolean>()) {
+        return value.as<Boolean>() ? "true" : "false";
+    }
+    if (value.is<const String*>()) {
+        return fmt::format("{}", *value.as<const String*>());
+    }
+    if (value.is<const Function*>()) {
+        return fmt::format("?Function {}?", value.as<const Function*>()->name);
+    }
+    if (value.is<const NativeFunction*>()) {
+        return fmt::format("?BuiltinFunction {}?", value.as<const NativeFunction*>()->name);
+    }
+    if (value.is<const Closure*>()) {
+        return fmt::format("?Function {}?", value.as<const Closure*>()->function->name);
+    }
+    return "nil";
+}
+
+
+const char* type_name(const Value& value) noexcept {
+    if (value.is<Number>()) { return "Number"; }
+    if (value.is<Boolean>()) { return "Boolean"; }
+    if (value.is<const String*>()) { return "String"; }
+    if (value.is<const Function*>()) { return "Function"; }
+    if (value.is<const Closure*>()) { return "Function"; }
+    if (value.is<const NativeFunction*>()) { return "BuiltinFunction"; }
+    return "Nil";
+}
@@ -1,10 +1,163 @@
 #pragma once
 #include "LiteralValue.hpp"
 #include "Utils.hpp"
+#include <variant>
+#include <string>
+#include <bit>
+#include <type_traits>
+#include <cassert>
+#include <cstdint>
 
-using Value = Number; // FIXME: change later
 
+struct Function;
+struct NativeFunction;
+struct Closure;
 
-inline std::string to_string(const Value& value) {
-    return std::string(num_to_string(value));
+
+// Runtime value of the VM. Much simpler than the tree-walker's Value:
+// no handles, and the objects are referred to by non-owning pointers.
+// The objects themselves are owned by the Heap, see Object.hpp.
+//
+// Two interchangeable representations, selected at compile time
+// with the LOX_VM_NAN_BOXING option:
+//   - NaN-boxed: 8 bytes, everything packed into the bits of a double;
+//   - tagged union: std::variant, the straightforward fallback.
+// Both expose the same is<T>() / as<T>() interface.
+#ifdef LOX_NAN_BOXING
+
+// Numbers are stored as is. Everything else lives in the payload
+// of a quiet NaN that no arithmetic operation produces:
+//   - nil, false and true are small constants;
+//   - objects have the sign bit set, the pointer in the low 48 bits
+//     and the type of the object in the 3 low bits of the pointer,
+//     free thanks to the alignment.
+// Real NaNs are canonicalized, so that they never look like a boxed value.
+class Value {
+private:
+    uint64_t bits_;
+
+    static constexpr uint64_t sign_bit{ 0x8000'0000'0000'0000 };
+    static constexpr uint64_t quiet_nan{ 0x7ffc'0000'0000'0000 };
+    static constexpr uint64_t canonical_nan{ 0x7ff8'0000'0000'0000 };
+
+    static constexpr uint64_t nil_bits{ quiet_nan | 1 };
+    static constexpr uint64_t false_bits{ quiet_nan | 2 };
+    static constexpr uint64_t true_bits{ quiet_nan | 3 };
+
+    static constexpr uint64_t object_bits{ sign_bit | quiet_nan };
+    static constexpr uint64_t tag_mask{ 0b111 };
+
+    template<typename T>
+    static constexpr uint64_t object_tag() noexcept {
+        if constexpr (std::is_same_v<T, const String*>) { return 0; }
+        else if constexpr (std::is_same_v<T, const Function*>) { return 1; }
+        else if constexpr (std::is_same_v<T, const NativeFunction*>) { return 2; }
+        else if constexpr (std::is_same_v<T, const Closure*>) { return 3; }
+        else { static_assert(sizeof(T) == 0, "Not an object type"); }
+    }
+
+    template<typename T>
+    static uint64_t box_object(T object) noexcept {
+        auto address = reinterpret_cast<uint64_t>(object);
+        assert((address & (object_bits | tag_mask)) == 0 && "Pointer does not fit");
+        return object_bits | address | object_tag<T>();
+    }
+
+public:
+    Value() noexcept : bits_{ nil_bits } {}
+    Value(Nil) noexcept : bits_{ nil_bits } {}
+    Value(Boolean boolean) noexcept : bits_{ boolean ? true_bits : false_bits } {}
+    Value(Number number) noexcept :
+        bits_{ number != number ? canonical_nan : std::bit_cast<uint64_t>(number) }
+    {}
+    Value(const String* string) noexcept : bits_{ box_object(string) } {}
+    Value(const Function* function) noexcept : bits_{ box_object(function) } {}
+    Value(const NativeFunction* native) noexcept : bits_{ box_object(native) } {}
+    Value(const Closure* closure) noexcept : bits_{ box_object(closure) } {}
+
+    template<typename T>
+    bool is() const noexcept {
+        if constexpr (std::is_same_v<T, Number>) {
+            return (bits_ & quiet_nan) != quiet_nan;
+        } else if constexpr (std::is_same_v<T, Nil>) {
+            return bits_ == nil_bits;
+        } else if constexpr (std::is_same_v<T, Boolean>) {
+            return (bits_ | 1) == true_bits;
+        } else {
+            return (bits_ & (object_bits | tag_mask)) == (object_bits | object_tag<T>());
+        }
+    }
+
+    template<typename T>
+    T as() const noexcept {
+        assert(is<T>());
+        if constexpr (std::is_same_v<T, Number>) {
+            return std::bit_cast<Number>(bits_);
+        } else if constexpr (std::is_same_v<T, Nil>) {
+            return Nil{};
+        } else if constexpr (std::is_same_v<T, Boolean>) {
+            return bits_ == true_bits;
+        } else {
+            return reinterpret_cast<T>(bits_ & ~(object_bits | tag_mask));
+        }
+    }
+
+    // Values of different types are never equal.
+    // Strings are compared by contents, other objects by identity.
+    bool operator==(const Value& other) const noexcept;
+};
+
+static_assert(sizeof(Value) == 8);
+
+#else
+
+class Value {
+private:
+    std::variant<
+        Nil, Boolean, Number,
+        const String*, const Function*, const NativeFunction*, const Closure*
+    > value_;
+
+public:
+    Value() = default;
+    Value(Nil) {}
+    Value(Boolean boolean) : value_{ boolean } {}
+    Value(Number number) : value_{ number } {}
+    Value(const String* string) : value_{ string } {}
+    Value(const Function* function) : value_{ function } {}
+    Value(const NativeFunction* native) : value_{ native } {}
+    Value(const Closure* closure) : value_{ closure } {}
+
+    template<typename T>
+    bool is() const noexcept {
+        return std::holds_alternative<T>(value_);
+    }
+
+    template<typename T>
+    T as() const noexcept {
+        assert(is<T>());
+        return *std::get_if<T>(&value_);
+    }
+
+    // Values of different types are never equal.
+    // Strings are compared by contents, other objects by identity.
+    bool operator==(const Value& other) const noexcept;
+};
+
+#endif
+
+
+inline bool is_truthful(const Value& value) noexcept {
+    if (value.is<Nil>()) {
+        return false;
+    }
+    if (value.is<Boolean>()) {
+        return value.as<Boolean>();
+    }
+    return true;
 }
+
+
+std::string to_string(const Value& value);
+
+const char* type_name(const Value& value) noexcept;
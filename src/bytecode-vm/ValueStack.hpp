@@ -1,41 +1,81 @@
 #pragma once
 #include "Value.hpp"
-#include <type_traits>
-#include <vector>
-#include <concepts>
+#include <memory>
+#include <cassert>
+#include <cstddef>
+#include <span>
 
 
+// Fixed-capacity stack, allocated once and never reallocated.
+// Does not check for overflow on push, see has_room().
 class ValueStack{
 private:
-    std::vector<Value> stack_;
+    std::unique_ptr<Value[]> data_;
+    Value* top_; // One past the last pushed value.
+    Value* end_;
 
 public:
-    void push(const Value& val) noexcept(std::is_nothrow_copy_constructible_v<Value>) {
-        stack_.emplace_back(val);
-    }
+    explicit ValueStack(size_t capacity) :
+        data_{ std::make_unique<Value[]>(capacity) },
+        top_{ data_.get() },
+        end_{ data_.get() + capacity }
+    {}
 
-    void push(Value&& val) noexcept(std::is_nothrow_move_constructible_v<Value>) {
-        stack_.emplace_back(std::move(val));
+    void push(const Value& val) noexcept {
+        assert(top_ != end_ && "Stack overflow");
+        *top_++ = val;
     }
 
-    Value pop() noexcept(std::is_nothrow_move_constructible_v<Value>) {
-        Value temp{ std::move(stack_.back()) };
-        stack_.pop_back();
-        return temp;
+    Value pop() noexcept {
+        assert(top_ != data_.get() && "Pop from an empty stack");
+        return *--top_;
     }
 
     Value& peek(size_t idx) noexcept {
-        assert(stack_.rbegin() + idx < stack_.rend() && "Peek access out of bounds");
-        return *(stack_.rbegin() + idx);
+        assert(idx < size() && "Peek access out of bounds");
+        return top_[-1 - static_cast<std::ptrdiff_t>(idx)];
     }
 
     const Value& peek(size_t idx) const noexcept {
-        assert(stack_.rbegin() + idx < stack_.rend() && "Peek access out of bounds");
-        return *(stack_.rbegin() + idx);
+        assert(idx < size() && "Peek access out of bounds");
+        return top_[-1 - static_cast<std::ptrdiff_t>(idx)];
+    }
+
+
+    Value& back() noexcept { return peek(0); }
+    const Value& back() const noexcept { return peek(0); }
+
+    // Indexed from the bottom of the stack.
+    Value& operator[](size_t idx) noexcept {
+        assert(idx < size() && "Out of bounds access");
+        return data_[idx];
+    }
+
+    const Value& operator[](size_t idx) const noexcept {
+        assert(idx < size() && "Out of bounds access");
+        return data_[idx];
     }
 
+    size_t size() const noexcept { return static_cast<size_t>(top_ - data_.get()); }
+    size_t capacity() const noexcept { return static_cast<size_t>(end_ - data_.get()); }
+
+    // Whether 'n' more values can be pushed.
+    bool has_room(size_t n) const noexcept {
+        return static_cast<size_t>(end_ - top_) >= n;
+    }
+
+    // The last 'n' values, in the order they were pushed.
+    std::span<Value> top(size_t n) noexcept {
+        assert(n <= size());
+        return { top_ - n, n };
+    }
+
+    // Pops everything above the 'new_size'.
+    void shrink(size_t new_size) noexcept {
+        assert(new_size <= size());
+        top_ = data_.get() + new_size;
+    }
 
-    Value& back() noexcept { return stack_.back(); }
-    const Value& back() const noexcept { return stack_.back(); }
+    void clear() noexcept { top_ = data_.get(); }
 
 };
@@ -0,0 +1,113 @@
+#include "Verifier.hpp"
+
+#include "Object.hpp"
+#include "StackDepth.hpp"
+#include "Value.hpp"
+#include <span>
+#include <vector>
+
+
+
+std::optional<size_t> verify_chunk(const Chunk& chunk, const Function* function, size_t num_globals) {
+    std::span<const Byte> bytes{ chunk.bytes() };
+    const Constants& constants{ chunk.constants() };
+    size_t num_upvalues{ function ? function->num_upvalues : 0 };
+    // The upvalue indices, constant indices and global slots.
+    auto below = [](size_t operand, size_t limit) { return operand < limit; };
+
+    auto read_short = [&](size_t offset) {
+        return (size_t(bytes[offset]) << 8) | bytes[offset + 1];
+    };
+    auto read_long = [&](size_t offset) {
+        return (size_t(bytes[offset]) << 16) | (size_t(bytes[offset + 1]) << 8) | bytes[offset + 2];
+    };
+
+    // Jump targets are checked once all of the instructions are known.
+    std::vector<bool> is_instruction(bytes.size(), false);
+    std::vector<size_t> targets;
+
+    size_t offset{ 0 };
+    while (offset < bytes.size()) {
+        if (bytes[offset] >= num_opcodes) {
+            return std::nullopt;
+        }
+        OP op{ bytes[offset] };
+        size_t next{ offset + 1 + operand_size(op) };
+        if (next > bytes.size()) {
+            return std::nullopt;
+        }
+        size_t operand{ offset + 1 };
+
+        bool valid{ true };
+        switch (op) {
+            case OP::CONSTANT:
+                valid = below(bytes[operand], constants.size());
+                break;
+            case OP::CONSTANT_LONG:
+                valid = below(read_long(operand), constants.size());
+                break;
+            case OP::ADD_LOCAL_CONST:
+            case OP::SUBTRACT_LOCAL_CONST:
+                valid = below(bytes[operand + 1], constants.size());
+                break;
+            case OP::GET_GLOBAL:
+            case OP::SET_GLOBAL:
+            case OP::DEFINE_GLOBAL:
+            case OP::SET_GLOBAL_POP:
+                valid = below(bytes[operand], num_globals);
+                break;
+            case OP::GET_GLOBAL_LONG:
+            case OP::SET_GLOBAL_LONG:
+            case OP::DEFINE_GLOBAL_LONG:
+                valid = below(read_long(operand), num_globals);
+                break;
+            case OP::GET_UPVALUE:
+            case OP::SET_UPVALUE:
+                valid = below(bytes[operand], num_upvalues);
+                break;
+            case OP::JUMP:
+            case OP::JUMP_IF_FALSE:
+                targets.push_back(next + read_short(operand));
+                break;
+            case OP::LESS_LOCAL_CONST_JUMP:
+                valid = below(bytes[operand + 1], constants.size());
+                targets.push_back(next + read_short(operand + 2));
+                break;
+            case OP::LOOP:
+                valid = read_short(operand) <= next;
+                targets.push_back(next - read_short(operand));
+                break;
+            case OP::CLOSURE: {
+                    size_t index{ read_long(operand) };
+                    if (!below(index, constants.size()) || !constants[index].is<const Function*>()) {
+                        return std::nullopt;
+                    }
+                    size_t num_captured{ constants[index].as<const Function*>()->num_upvalues };
+                    if (bytes.size() - next < 2 * num_captured) {
+                        return std::nullopt;
+                    }
+                    // The locals are left to the max_stack_depth().
+                    for (size_t i{ 0 }; i < num_captured; ++i, next += 2) {
+                        Byte is_local{ bytes[next] };
+                        valid = valid && is_local <= 1 && (is_local || below(bytes[next + 1], num_upvalues));
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+        if (!valid) {
+            return std::nullopt;
+        }
+        is_instruction[offset] = true;
+        offset = next;
+    }
+
+    for (size_t target : targets) {
+        if (target >= bytes.size() || !is_instruction[target]) {
+            return std::nullopt;
+        }
+    }
+
+    return max_stack_depth(chunk, function ? function->arity + 1 : 0);
+}
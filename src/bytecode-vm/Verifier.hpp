@@ -0,0 +1,21 @@
+#pragma once
+#include "Chunk.hpp"
+#include <optional>
+#include <cstddef>
+
+
+struct Function;
+
+
+// Checks the bytecode read from a cache before the VM runs it,
+// the VM trusts the bytecode and would read out of bounds on any of:
+//   - an opcode past the OP enum, or an instruction cut off by the end of the chunk;
+//   - a constant, global or upvalue operand out of range;
+//   - CLOSURE of a constant that's not a Function;
+//   - a jump out of the chunk, or into the middle of an instruction;
+//   - the stack depth checks of max_stack_depth().
+//
+// The 'function' is the one the chunk belongs to, null for the top-level code.
+// Not recursive, the chunks of the nested functions are verified separately.
+// Returns the max_stack_depth() of the chunk, nothing if it's invalid.
+std::optional<size_t> verify_chunk(const Chunk& chunk, const Function* function, size_t num_globals);
@@ -8,6 +8,7 @@
 #include "RunContext.hpp"
 #include "VM.hpp"
 #include <iostream>
+#include <memory>
 
 int main(int argc, const char* argv[]) {
 
@@ -31,6 +32,15 @@ int main(int argc, const char* argv[]) {
     }
 
 
+#ifndef LOX_PROFILE
+    if (args.profile_opcodes) {
+        err.error(std::make_unique<CLIArgsError>(
+            "lox-bvm is built without the profiler, configure with -DLOX_VM_PROFILING=ON"
+        ));
+        return 1;
+    }
+#endif
+
     RunContext context{ err, args };
 
     context.start_running();
@@ -0,0 +1,223 @@
+#include "ASTOptimizer.hpp"
+
+#include "Token.hpp"
+#include "TokenType.hpp"
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+
+namespace {
+
+bool is_truthful(const LiteralValue& value) noexcept {
+    if (std::holds_alternative<Nil>(value)) {
+        return false;
+    }
+    if (std::holds_alternative<Boolean>(value)) {
+        return std::get<Boolean>(value);
+    }
+    return true;
+}
+
+std::unique_ptr<Stmt> make_empty_block() {
+    return Stmt::make_unique<BlockStmt>(std::vector<std::unique_ptr<Stmt>>{});
+}
+
+} // namespace
+
+
+
+
+void ASTOptimizer::optimize(std::span<std::unique_ptr<Stmt>> stmts) const {
+    for (auto& stmt : stmts) {
+        optimize(stmt);
+    }
+}
+
+
+void ASTOptimizer::optimize(std::unique_ptr<Stmt>& stmt) const {
+    if (stmt->is<ExpressionStmt>()) {
+        optimize(stmt->as<ExpressionStmt>().expr);
+    } else if (stmt->is<PrintStmt>()) {
+        optimize(stmt->as<PrintStmt>().expr);
+    } else if (stmt->is<VarStmt>()) {
+        auto& var = stmt->as<VarStmt>();
+        if (var.init) {
+            optimize(var.init);
+        }
+    } else if (stmt->is<BlockStmt>()) {
+        optimize(stmt->as<BlockStmt>().statements);
+    } else if (stmt->is<IfStmt>()) {
+        auto& if_stmt = stmt->as<IfStmt>();
+        optimize(if_stmt.condition);
+        optimize(if_stmt.then_branch);
+        if (if_stmt.else_branch) {
+            optimize(if_stmt.else_branch);
+        }
+        if (auto condition = literal_of(*if_stmt.condition)) {
+            std::unique_ptr<Stmt> taken{
+                is_truthful(*condition) ? std::move(if_stmt.then_branch) : std::move(if_stmt.else_branch)
+            };
+            stmt = taken ? std::move(taken) : make_empty_block();
+        }
+    } else if (stmt->is<WhileStmt>()) {
+        auto& while_stmt = stmt->as<WhileStmt>();
+        optimize(while_stmt.condition);
+        optimize(while_stmt.statement);
+        auto condition = literal_of(*while_stmt.condition);
+        if (condition && !is_truthful(*condition)) {
+            stmt = make_empty_block();
+        }
+    } else if (stmt->is<FunStmt>()) {
+        optimize(stmt->as<FunStmt>().body);
+    } else if (stmt->is<ReturnStmt>()) {
+        auto& return_stmt = stmt->as<ReturnStmt>();
+        if (return_stmt.expr) {
+            optimize(return_stmt.expr);
+        }
+    }
+    // ImportStmt: nothing to do.
+}
+
+
+void ASTOptimizer::optimize(std::unique_ptr<Expr>& expr) const {
+    if (expr->is<GroupedExpr>()) {
+        std::unique_ptr<Expr> inner{ std::move(expr->as<GroupedExpr>().expr) };
+        optimize(inner);
+        expr = std::move(inner);
+    } else if (expr->is<UnaryExpr>()) {
+        auto& unary = expr->as<UnaryExpr>();
+        optimize(unary.operand);
+        if (auto operand = literal_of(*unary.operand)) {
+            if (auto result = fold_unary(unary.op, *operand)) {
+                expr = make_literal(std::move(*result), unary.op);
+            }
+        }
+    } else if (expr->is<BinaryExpr>()) {
+        auto& binary = expr->as<BinaryExpr>();
+        optimize(binary.lhs);
+        optimize(binary.rhs);
+        auto lhs = literal_of(*binary.lhs);
+        auto rhs = literal_of(*binary.rhs);
+        if (lhs && rhs) {
+            if (auto result = fold_binary(binary.op, *lhs, *rhs)) {
+                expr = make_literal(std::move(*result), binary.op);
+            }
+        }
+    } else if (expr->is<LogicalExpr>()) {
+        auto& logical = expr->as<LogicalExpr>();
+        optimize(logical.lhs);
+        optimize(logical.rhs);
+        // The result is either of the operands, as is.
+        if (auto lhs = literal_of(*logical.lhs)) {
+            bool short_circuits{
+                logical.op.type() == TokenType::kw_or ? is_truthful(*lhs) : !is_truthful(*lhs)
+            };
+            std::unique_ptr<Expr> result{
+                short_circuits ? std::move(logical.lhs) : std::move(logical.rhs)
+            };
+            expr = std::move(result);
+        }
+    } else if (expr->is<AssignExpr>()) {
+        optimize(expr->as<AssignExpr>().rvalue);
+    } else if (expr->is<CallExpr>()) {
+        auto& call = expr->as<CallExpr>();
+        optimize(call.callee);
+        for (auto& arg : call.args) {
+            optimize(arg);
+        }
+    }
+    // LiteralExpr, VariableExpr: nothing to do.
+}
+
+
+
+
+std::optional<LiteralValue> ASTOptimizer::literal_of(const Expr& expr) {
+    if (expr.is<LiteralExpr>() && expr.as<LiteralExpr>().token.has_literal()) {
+        return expr.as<LiteralExpr>().token.literal();
+    }
+    return {};
+}
+
+
+std::optional<LiteralValue> ASTOptimizer::fold_unary(const Token& op, const LiteralValue& operand) {
+    switch (op.type()) {
+        case TokenType::minus:
+            if (std::holds_alternative<Number>(operand)) {
+                return -std::get<Number>(operand);
+            }
+            return {};
+        case TokenType::bang:
+            return !is_truthful(operand);
+        default:
+            return {};
+    }
+}
+
+
+std::optional<LiteralValue> ASTOptimizer::fold_binary(
+    const Token& op, const LiteralValue& lhs, const LiteralValue& rhs)
+{
+    using enum TokenType;
+
+    switch (op.type()) {
+        case eq_eq:
+            return lhs == rhs;
+        case bang_eq:
+            return lhs != rhs;
+        case plus:
+            if (std::holds_alternative<String>(lhs) && std::holds_alternative<String>(rhs)) {
+                return std::get<String>(lhs) + std::get<String>(rhs);
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (!std::holds_alternative<Number>(lhs) || !std::holds_alternative<Number>(rhs)) {
+        return {};
+    }
+    Number a{ std::get<Number>(lhs) };
+    Number b{ std::get<Number>(rhs) };
+
+    switch (op.type()) {
+        case plus: return a + b;
+        case minus: return a - b;
+        case star: return a * b;
+        case slash: return a / b;
+        case greater: return a > b;
+        case greater_eq: return a >= b;
+        case less: return a < b;
+        case less_eq: return a <= b;
+        default: return {};
+    }
+}
+
+
+std::unique_ptr<Expr> ASTOptimizer::make_literal(LiteralValue value, const Token& where) {
+    TokenType type{
+        std::visit(
+            [](const auto& alt) {
+                using T = std::decay_t<decltype(alt)>;
+                if constexpr (std::is_same_v<T, Number>) {
+                    return TokenType::number;
+                } else if constexpr (std::is_same_v<T, String>) {
+                    return TokenType::string;
+                } else if constexpr (std::is_same_v<T, Boolean>) {
+                    return alt ? TokenType::kw_true : TokenType::kw_false;
+                } else {
+                    return TokenType::kw_nil;
+                }
+            },
+            value
+        )
+    };
+    std::string lexeme{ to_string(value) };
+    return Expr::make_unique<LiteralExpr>(
+        Token{ type, std::move(lexeme), where.location(), std::move(value) }
+    );
+}
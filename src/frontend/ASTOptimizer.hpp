@@ -0,0 +1,39 @@
+#pragma once
+#include "Expr.hpp"
+#include "Stmt.hpp"
+#include "LiteralValue.hpp"
+#include <memory>
+#include <optional>
+#include <span>
+
+
+// Simplifies the resolved AST before it's handed to the backend:
+//
+// - folds UnaryExpr, BinaryExpr and LogicalExpr over literal operands;
+// - replaces the IfStmt with a literal condition with the taken branch,
+//   and drops the WhileStmt with a falsy literal condition;
+// - unwraps the GroupedExpr.
+//
+// Only folds what evaluates without errors, the rest is left
+// to fail at runtime, same as before. Runs after the Resolver,
+// the dropped branches are scopes of their own, so the bindings
+// of the remaining code stay valid.
+class ASTOptimizer {
+public:
+    void optimize(std::span<std::unique_ptr<Stmt>> stmts) const;
+
+private:
+    void optimize(std::unique_ptr<Stmt>& stmt) const;
+    void optimize(std::unique_ptr<Expr>& expr) const;
+
+    // Nothing if the 'expr' is not a literal.
+    static std::optional<LiteralValue> literal_of(const Expr& expr);
+
+    static std::optional<LiteralValue> fold_unary(const Token& op, const LiteralValue& operand);
+    static std::optional<LiteralValue> fold_binary(
+        const Token& op, const LiteralValue& lhs, const LiteralValue& rhs
+    );
+
+    // A LiteralExpr with the 'value', located at the 'where'.
+    static std::unique_ptr<Expr> make_literal(LiteralValue value, const Token& where);
+};
@@ -20,6 +20,13 @@ struct CLIArgs {
     bool debug_scanner{};
     bool debug_parser{};
     bool debug_bytecode{};
+    bool no_cache{};
+    // Of the bytecode, 0 to disable the optimizations.
+    int opt_level{ 1 };
+    bool profile_opcodes{};
+    bool profile_cycles{};
+    // Tree-walker only, see FlatInterpreter.
+    bool flat_ast{};
 };
 
 class CLIArgsError : public IError {
@@ -54,6 +61,13 @@ public:
             "debug", "Run in debug mode.",
             cxxopts::value<std::vector<std::string>>()->implicit_value("scanner,parser,bytecode")
         )
+        ("no-cache", "Do not read or write the compiled bytecode cache (.loxc)")
+        ("flat-ast", "Interpret the flattened AST (tree-walker only)")
+        ("opt-level", "Bytecode optimization level: 0 or 1 (default)", cxxopts::value<int>())
+        (
+            "profile", "Profile the executed bytecode: opcodes, cycles.",
+            cxxopts::value<std::vector<std::string>>()->implicit_value("opcodes")
+        )
         ("file", "Input file to be parsed", cxxopts::value<std::string>());
 
         opts_.parse_positional("file");
@@ -72,12 +86,14 @@ public:
             return args;
         }
 
-        if (!resolve_debug_flags(args)) {
+        if (!resolve_debug_flags(args) || !resolve_opt_level(args) || !resolve_profile_flags(args)) {
             args.parse_failed = true;
             return args;
         }
 
         args.show_help = args.result.count("help");
+        args.no_cache = args.result.count("no-cache");
+        args.flat_ast = args.result.count("flat-ast");
 
         args.filename =
             std::invoke(
@@ -97,6 +113,43 @@ public:
     cxxopts::Options& options() noexcept { return opts_; }
 
 private:
+    bool resolve_opt_level(CLIArgs& args) {
+        if (args.result.count("opt-level")) {
+            args.opt_level = args.result["opt-level"].as<int>();
+            if (args.opt_level < 0 || args.opt_level > 1) {
+                send_error(
+                    fmt::format("Unknown optimization level: {:d}", args.opt_level)
+                );
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool resolve_profile_flags(CLIArgs& args) {
+        bool failed{ false };
+
+        if (args.result.count("profile")) {
+
+            decltype(auto) profile_args = args.result["profile"].as<std::vector<std::string>>();
+
+            for (const auto& arg : profile_args) {
+                if (arg == "opcodes") {
+                    args.profile_opcodes = true;
+                } else if (arg == "cycles") {
+                    args.profile_opcodes = true;
+                    args.profile_cycles = true;
+                } else {
+                    send_error(
+                        fmt::format("Unknown profile option: '{:s}'", arg)
+                    );
+                    failed = true;
+                }
+            }
+        }
+        return !failed;
+    }
+
     bool resolve_debug_flags(CLIArgs& args) {
         bool failed{ false };
 
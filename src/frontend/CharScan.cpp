@@ -0,0 +1,299 @@
+#include "CharScan.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && \
+    (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LOX_CHAR_SCAN_X86
+#define LOX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+
+namespace char_scan {
+
+namespace {
+
+// Plain loops. Also finish the tails of the vectorized versions,
+// that are too short for a whole vector.
+
+bool is_blank(char c) noexcept {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool is_identifier(char c) noexcept {
+    return (
+        (c >= 'a' && c <= 'z') ||
+        (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') ||
+        (c == '_')
+    );
+}
+
+bool is_line_end(char c) noexcept {
+    return c == '\n';
+}
+
+bool is_quote_or_line_end(char c) noexcept {
+    return c == '"' || c == '\n';
+}
+
+
+// Skips the characters while they match, if 'Skip',
+// otherwise until the first one that does.
+template<bool (*Match)(char) noexcept, bool Skip>
+const char* scan_scalar(const char* first, const char* last) noexcept {
+    while (first != last && Match(*first) == Skip) {
+        ++first;
+    }
+    return first;
+}
+
+
+
+#ifdef LOX_CHAR_SCAN_X86
+
+// Every byte of the vector is compared at once, the movemask of the result
+// has a bit set for each matching character, the first one is the lowest.
+namespace sse2 {
+
+using Vec = __m128i;
+
+Vec eq(Vec v, char c) noexcept {
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+// 'lo' <= c < 'lo' + 'size'. There's only the signed compare,
+// so the range is shifted to start at the smallest signed value.
+Vec in_range(Vec v, char lo, char size) noexcept {
+    Vec shifted{ _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - lo))) };
+    return _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(0x80 + size)), shifted);
+}
+
+Vec blank(Vec v) noexcept {
+    return _mm_or_si128(_mm_or_si128(eq(v, ' '), eq(v, '\t')), eq(v, '\r'));
+}
+
+Vec identifier(Vec v) noexcept {
+    // Lowercase, the rest of the characters don't land in the range.
+    Vec lower{ _mm_or_si128(v, _mm_set1_epi8(0x20)) };
+    return _mm_or_si128(
+        _mm_or_si128(in_range(lower, 'a', 26), in_range(v, '0', 10)),
+        eq(v, '_')
+    );
+}
+
+Vec line_end(Vec v) noexcept {
+    return eq(v, '\n');
+}
+
+Vec quote_or_line_end(Vec v) noexcept {
+    return _mm_or_si128(eq(v, '"'), eq(v, '\n'));
+}
+
+
+template<Vec (*Match)(Vec) noexcept, bool (*ScalarMatch)(char) noexcept, bool Skip>
+const char* scan(const char* first, const char* last) noexcept {
+    while (last - first >= 16) {
+        Vec chars{ _mm_loadu_si128(reinterpret_cast<const Vec*>(first)) };
+        auto matched = static_cast<uint32_t>(_mm_movemask_epi8(Match(chars)));
+        uint32_t stops{ Skip ? ~matched & 0xFFFFu : matched };
+        if (stops != 0) {
+            return first + std::countr_zero(stops);
+        }
+        first += 16;
+    }
+    return scan_scalar<ScalarMatch, Skip>(first, last);
+}
+
+} // namespace sse2
+
+
+
+// Same as the SSE2 version, 32 characters at a time.
+namespace avx2 {
+
+using Vec = __m256i;
+
+LOX_TARGET_AVX2 Vec eq(Vec v, char c) noexcept {
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+LOX_TARGET_AVX2 Vec in_range(Vec v, char lo, char size) noexcept {
+    Vec shifted{ _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - lo))) };
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + size)), shifted);
+}
+
+LOX_TARGET_AVX2 Vec blank(Vec v) noexcept {
+    return _mm256_or_si256(_mm256_or_si256(eq(v, ' '), eq(v, '\t')), eq(v, '\r'));
+}
+
+LOX_TARGET_AVX2 Vec identifier(Vec v) noexcept {
+    Vec lower{ _mm256_or_si256(v, _mm256_set1_epi8(0x20)) };
+    return _mm256_or_si256(
+        _mm256_or_si256(in_range(lower, 'a', 26), in_range(v, '0', 10)),
+        eq(v, '_')
+    );
+}
+
+LOX_TARGET_AVX2 Vec line_end(Vec v) noexcept {
+    return eq(v, '\n');
+}
+
+LOX_TARGET_AVX2 Vec quote_or_line_end(Vec v) noexcept {
+    return _mm256_or_si256(eq(v, '"'), eq(v, '\n'));
+}
+
+
+// Most of the runs are short, so the first 16 characters, and the tail,
+// go through the SSE2 version.
+template<
+    Vec (*Match)(Vec) noexcept,
+    sse2::Vec (*TailMatch)(sse2::Vec) noexcept,
+    bool (*ScalarMatch)(char) noexcept,
+    bool Skip
+>
+LOX_TARGET_AVX2 const char* scan(const char* first, const char* last) noexcept {
+    if (last - first >= 16) {
+        sse2::Vec chars{ _mm_loadu_si128(reinterpret_cast<const sse2::Vec*>(first)) };
+        auto matched = static_cast<uint32_t>(_mm_movemask_epi8(TailMatch(chars)));
+        uint32_t stops{ Skip ? ~matched & 0xFFFFu : matched };
+        if (stops != 0) {
+            return first + std::countr_zero(stops);
+        }
+        first += 16;
+    }
+    while (last - first >= 32) {
+        Vec chars{ _mm256_loadu_si256(reinterpret_cast<const Vec*>(first)) };
+        auto matched = static_cast<uint32_t>(_mm256_movemask_epi8(Match(chars)));
+        uint32_t stops{ Skip ? ~matched : matched };
+        if (stops != 0) {
+            return first + std::countr_zero(stops);
+        }
+        first += 32;
+    }
+    return sse2::scan<TailMatch, ScalarMatch, Skip>(first, last);
+}
+
+} // namespace avx2
+
+#endif // LOX_CHAR_SCAN_X86
+
+
+
+using scan_t = const char* (*)(const char*, const char*) noexcept;
+
+struct Kernels {
+    Isa isa;
+    scan_t skip_blanks;
+    scan_t skip_identifier;
+    scan_t find_line_end;
+    scan_t find_quote_or_line_end;
+};
+
+constexpr Kernels scalar_kernels{
+    Isa::scalar,
+    &scan_scalar<is_blank, true>,
+    &scan_scalar<is_identifier, true>,
+    &scan_scalar<is_line_end, false>,
+    &scan_scalar<is_quote_or_line_end, false>
+};
+
+#ifdef LOX_CHAR_SCAN_X86
+constexpr Kernels sse2_kernels{
+    Isa::sse2,
+    &sse2::scan<sse2::blank, is_blank, true>,
+    &sse2::scan<sse2::identifier, is_identifier, true>,
+    &sse2::scan<sse2::line_end, is_line_end, false>,
+    &sse2::scan<sse2::quote_or_line_end, is_quote_or_line_end, false>
+};
+
+constexpr Kernels avx2_kernels{
+    Isa::avx2,
+    &avx2::scan<avx2::blank, sse2::blank, is_blank, true>,
+    &avx2::scan<avx2::identifier, sse2::identifier, is_identifier, true>,
+    &avx2::scan<avx2::line_end, sse2::line_end, is_line_end, false>,
+    &avx2::scan<avx2::quote_or_line_end, sse2::quote_or_line_end, is_quote_or_line_end, false>
+};
+#endif
+
+
+bool is_supported(Isa isa) noexcept {
+    switch (isa) {
+        case Isa::scalar:
+            return true;
+#ifdef LOX_CHAR_SCAN_X86
+        case Isa::sse2:
+            return true;
+        case Isa::avx2:
+            // Runs before main(), the CPU info may be not yet initialized.
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+const Kernels& kernels_for(Isa isa) noexcept {
+    switch (isa) {
+#ifdef LOX_CHAR_SCAN_X86
+        case Isa::sse2:
+            return sse2_kernels;
+        case Isa::avx2:
+            return avx2_kernels;
+#endif
+        default:
+            return scalar_kernels;
+    }
+}
+
+const Kernels& best_kernels() noexcept {
+    for (Isa isa : { Isa::avx2, Isa::sse2 }) {
+        if (is_supported(isa)) {
+            return kernels_for(isa);
+        }
+    }
+    return scalar_kernels;
+}
+
+
+const Kernels* active{ &best_kernels() };
+
+} // namespace
+
+
+
+Isa isa() noexcept {
+    return active->isa;
+}
+
+bool use_isa(Isa isa) noexcept {
+    if (!is_supported(isa)) {
+        return false;
+    }
+    active = &kernels_for(isa);
+    return true;
+}
+
+
+const char* skip_blanks(const char* first, const char* last) noexcept {
+    return active->skip_blanks(first, last);
+}
+
+const char* skip_identifier(const char* first, const char* last) noexcept {
+    return active->skip_identifier(first, last);
+}
+
+const char* find_line_end(const char* first, const char* last) noexcept {
+    return active->find_line_end(first, last);
+}
+
+const char* find_quote_or_line_end(const char* first, const char* last) noexcept {
+    return active->find_quote_or_line_end(first, last);
+}
+
+} // namespace char_scan
@@ -0,0 +1,39 @@
+#pragma once
+
+
+
+// Searches over the source text for the runs of characters
+// that the Scanner would otherwise step through one by one.
+//
+// Each one returns the position in [first, last) where the run ends,
+// or 'last'. The implementation is picked at startup by what the CPU
+// supports: AVX2, SSE2, or plain loops elsewhere.
+namespace char_scan {
+
+enum class Isa {
+    scalar,
+    sse2,
+    avx2
+};
+
+// The implementation in use.
+Isa isa() noexcept;
+
+// Switches the implementation, for the tests and benchmarks.
+// Returns false, and changes nothing, if the CPU does not support it.
+bool use_isa(Isa isa) noexcept;
+
+// Spaces, tabs and carriage returns. Not newlines,
+// the Scanner has to count those.
+const char* skip_blanks(const char* first, const char* last) noexcept;
+
+// Letters, digits and underscores.
+const char* skip_identifier(const char* first, const char* last) noexcept;
+
+// Up to the next newline, the body of a // comment.
+const char* find_line_end(const char* first, const char* last) noexcept;
+
+// Up to the next quote or newline, the body of a string literal.
+const char* find_quote_or_line_end(const char* first, const char* last) noexcept;
+
+} // namespace char_scan
@@ -0,0 +1,164 @@
+#include "FlatAST.hpp"
+
+#include <utility>
+
+
+static_assert(sizeof(FlatAST::Node) == 16);
+
+
+
+FlatAST::Range FlatAST::append(std::span<const std::unique_ptr<Stmt>> stmts) {
+    std::vector<Index> top_level;
+    top_level.reserve(stmts.size());
+    for (const auto& stmt : stmts) {
+        top_level.push_back(flatten(*stmt));
+    }
+    return append_list(top_level);
+}
+
+
+
+
+// The parent is added before the children, so that the nodes
+// are laid out in the order in which they are evaluated.
+// The nodes_ could reallocate while the children are flattened,
+// index them again instead of holding a reference.
+FlatAST::Index FlatAST::flatten(const Stmt& stmt) {
+    Index index{ add_node({ Kind::import }) };
+
+    if (stmt.is<ExpressionStmt>()) {
+        Index expr{ flatten(*stmt.as<ExpressionStmt>().expr) };
+        nodes_[index] = { .kind = Kind::expression, .a = expr };
+    } else if (stmt.is<PrintStmt>()) {
+        Index expr{ flatten(*stmt.as<PrintStmt>().expr) };
+        nodes_[index] = { .kind = Kind::print, .a = expr };
+    } else if (stmt.is<VarStmt>()) {
+        const auto& var = stmt.as<VarStmt>();
+        Index init{ flatten(*var.init) };
+        nodes_[index] = { .kind = Kind::var, .a = var.slot, .b = init };
+    } else if (stmt.is<BlockStmt>()) {
+        const auto& block = stmt.as<BlockStmt>();
+        std::vector<Index> statements;
+        statements.reserve(block.statements.size());
+        for (const auto& statement : block.statements) {
+            statements.push_back(flatten(*statement));
+        }
+        Range range{ append_list(statements) };
+        nodes_[index] = {
+            .kind = Kind::block, .a = range.first, .b = range.size, .c = block.num_slots
+        };
+    } else if (stmt.is<IfStmt>()) {
+        const auto& if_stmt = stmt.as<IfStmt>();
+        Index condition{ flatten(*if_stmt.condition) };
+        Index then_branch{ flatten(*if_stmt.then_branch) };
+        Index else_branch{ if_stmt.else_branch ? flatten(*if_stmt.else_branch) : none };
+        nodes_[index] = {
+            .kind = Kind::if_, .a = condition, .b = then_branch, .c = else_branch
+        };
+    } else if (stmt.is<WhileStmt>()) {
+        const auto& while_stmt = stmt.as<WhileStmt>();
+        Index condition{ flatten(*while_stmt.condition) };
+        Index body{ flatten(*while_stmt.statement) };
+        nodes_[index] = { .kind = Kind::while_, .a = condition, .b = body };
+    } else if (stmt.is<FunStmt>()) {
+        const auto& fun = stmt.as<FunStmt>();
+        std::vector<Index> body;
+        body.reserve(fun.body.size());
+        for (const auto& statement : fun.body) {
+            body.push_back(flatten(*statement));
+        }
+        Range range{ append_list(body) };
+        auto function = Index(functions_.size());
+        functions_.push_back({ &fun, range.first, range.size });
+        nodes_[index] = { .kind = Kind::fun, .a = function };
+    } else if (stmt.is<ReturnStmt>()) {
+        Index expr{ flatten(*stmt.as<ReturnStmt>().expr) };
+        nodes_[index] = { .kind = Kind::ret, .a = expr };
+    }
+    // ImportStmt: already in place.
+
+    return index;
+}
+
+
+
+
+FlatAST::Index FlatAST::flatten(const Expr& expr) {
+    if (expr.is<GroupedExpr>()) {
+        return flatten(*expr.as<GroupedExpr>().expr);
+    }
+
+    Index index{ add_node({ Kind::literal }, &expr) };
+
+    if (expr.is<LiteralExpr>()) {
+        const auto& literal = expr.as<LiteralExpr>();
+        assert(literal.token.has_literal());
+        nodes_[index] = { .kind = Kind::literal, .a = add_constant(literal.token.literal()) };
+    } else if (expr.is<UnaryExpr>()) {
+        const auto& unary = expr.as<UnaryExpr>();
+        Index operand{ flatten(*unary.operand) };
+        nodes_[index] = { .kind = Kind::unary, .op = unary.op.type(), .a = operand };
+    } else if (expr.is<BinaryExpr>()) {
+        const auto& binary = expr.as<BinaryExpr>();
+        Index lhs{ flatten(*binary.lhs) };
+        Index rhs{ flatten(*binary.rhs) };
+        nodes_[index] = { .kind = Kind::binary, .op = binary.op.type(), .a = lhs, .b = rhs };
+    } else if (expr.is<VariableExpr>()) {
+        const Binding& binding{ expr.as<VariableExpr>().binding };
+        nodes_[index] = {
+            .kind = Kind::variable, .binding = binding.kind,
+            .a = binding.depth, .b = binding.slot
+        };
+    } else if (expr.is<AssignExpr>()) {
+        const auto& assign = expr.as<AssignExpr>();
+        Index rvalue{ flatten(*assign.rvalue) };
+        nodes_[index] = {
+            .kind = Kind::assign, .binding = assign.binding.kind,
+            .a = assign.binding.depth, .b = assign.binding.slot, .c = rvalue
+        };
+    } else if (expr.is<LogicalExpr>()) {
+        const auto& logical = expr.as<LogicalExpr>();
+        Index lhs{ flatten(*logical.lhs) };
+        Index rhs{ flatten(*logical.rhs) };
+        nodes_[index] = { .kind = Kind::logical, .op = logical.op.type(), .a = lhs, .b = rhs };
+    } else if (expr.is<CallExpr>()) {
+        const auto& call = expr.as<CallExpr>();
+        Index callee{ flatten(*call.callee) };
+        std::vector<Index> args;
+        args.reserve(call.args.size());
+        for (const auto& arg : call.args) {
+            args.push_back(flatten(*arg));
+        }
+        Range range{ append_list(args) };
+        nodes_[index] = { .kind = Kind::call, .a = callee, .b = range.first, .c = range.size };
+    }
+
+    return index;
+}
+
+
+
+
+FlatAST::Range FlatAST::append_list(const std::vector<Index>& indices) {
+    auto first = Index(lists_.size());
+    lists_.insert(lists_.end(), indices.begin(), indices.end());
+    return { first, Index(indices.size()) };
+}
+
+
+FlatAST::Index FlatAST::add_node(Node node, const Expr* source) {
+    auto index = Index(nodes_.size());
+    assert(index != none);
+    nodes_.push_back(node);
+    sources_.push_back(source);
+    return index;
+}
+
+
+FlatAST::Index FlatAST::add_constant(const LiteralValue& value) {
+    auto [it, inserted] = constant_ids_.try_emplace(to_string(value), Index(constants_.size()));
+    if (inserted) {
+        constants_.push_back(value);
+    }
+    return it->second;
+}
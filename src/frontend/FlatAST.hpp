@@ -0,0 +1,141 @@
+#pragma once
+#include "Expr.hpp"
+#include "Stmt.hpp"
+#include "Binding.hpp"
+#include "LiteralValue.hpp"
+#include "TokenType.hpp"
+#include <boost/unordered_map.hpp>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+
+// An alternative, flattened layout of the resolved AST.
+//
+// The nodes of all the passes are stored in a single contiguous vector,
+// the children are referenced by their 32-bit indices into it.
+// The nodes carry no Tokens: the literals are interned into
+// a table of constants, and the original Expr of each expression node
+// is kept aside, for the error reporting only.
+//
+// The lists of children (statements of a block, arguments of a call)
+// are stored as contiguous runs of indices in a separate vector.
+//
+// The GroupedExpr nodes are dropped, evaluating the group
+// is the same as evaluating the grouped expression.
+class FlatAST {
+public:
+    using Index = uint32_t;
+
+    static constexpr Index none{ std::numeric_limits<Index>::max() };
+
+    enum class Kind : uint8_t {
+        // Expressions
+        literal,    // a: constant
+        unary,      // op, a: operand
+        binary,     // op, a: lhs, b: rhs
+        variable,   // binding, a: depth, b: slot
+        assign,     // binding, a: depth, b: slot, c: rvalue
+        logical,    // op, a: lhs, b: rhs
+        call,       // a: callee, b: first argument in the lists, c: number of arguments
+        // Statements
+        expression, // a: expr
+        print,      // a: expr
+        var,        // a: slot, b: init
+        block,      // a: first statement in the lists, b: number of statements, c: number of slots
+        if_,        // a: condition, b: then branch, c: else branch or none
+        while_,     // a: condition, b: body
+        fun,        // a: function, see FlatAST::Function
+        ret,        // a: expr
+        import,
+    };
+
+    // 16 bytes, four to a cache line.
+    struct Node {
+        Kind kind;
+        TokenType op{};
+        Binding::Kind binding{};
+        Index a{ none };
+        Index b{ none };
+        Index c{ none };
+    };
+
+    struct Function {
+        const FunStmt* declaration;
+        Index first;        // First statement of the body in the lists
+        Index size;         // Number of statements in the body
+    };
+
+    // A run of indices in the lists.
+    struct Range {
+        Index first;
+        Index size;
+    };
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<Index> lists_;
+    std::vector<LiteralValue> constants_;
+    std::vector<Function> functions_;
+    // Parallel to the nodes_, nullptr for the statements.
+    std::vector<const Expr*> sources_;
+
+    // Keyed by to_string() of the literal,
+    // which tells apart the Strings from the Numbers.
+    boost::unordered_map<std::string, Index> constant_ids_;
+
+public:
+    // Flattens the (resolved) 'stmts' and appends them to the tree.
+    // Returns the range of the new top-level statements in the lists.
+    //
+    // The FunStmt nodes are referenced by the Functions,
+    // the 'stmts' must outlive the FlatAST.
+    Range append(std::span<const std::unique_ptr<Stmt>> stmts);
+
+    const Node& node(Index index) const noexcept {
+        assert(index < nodes_.size());
+        return nodes_[index];
+    }
+
+    std::span<const Index> list(Index first, Index size) const noexcept {
+        assert(first + size <= lists_.size());
+        return { lists_.data() + first, size };
+    }
+
+    std::span<const Index> list(Range range) const noexcept {
+        return list(range.first, range.size);
+    }
+
+    const LiteralValue& constant(Index index) const noexcept {
+        assert(index < constants_.size());
+        return constants_[index];
+    }
+
+    const Function& function(Index index) const noexcept {
+        assert(index < functions_.size());
+        return functions_[index];
+    }
+
+    // The Expr the expression node was flattened from.
+    const Expr& source(Index index) const noexcept {
+        assert(index < sources_.size() && sources_[index]);
+        return *sources_[index];
+    }
+
+    size_t num_nodes() const noexcept { return nodes_.size(); }
+    size_t num_constants() const noexcept { return constants_.size(); }
+
+private:
+    Index flatten(const Stmt& stmt);
+    Index flatten(const Expr& expr);
+
+    // The 'indices' are copied into the lists as a contiguous run.
+    Range append_list(const std::vector<Index>& indices);
+
+    Index add_node(Node node, const Expr* source = nullptr);
+    Index add_constant(const LiteralValue& value);
+};
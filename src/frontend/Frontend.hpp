@@ -1,19 +1,24 @@
 #pragma once
+#include "ASTOptimizer.hpp"
 #include "ErrorReporter.hpp"
 #include "IError.hpp"
 #include "Scanner.hpp"
 #include "Importer.hpp"
 #include "Parser.hpp"
 #include "Resolver.hpp"
+#include "SourceManager.hpp"
 #include <filesystem>
 #include <memory>
 #include <optional>
 #include <span>
+#include <string_view>
 #include <vector>
 
 struct FrontendConfig {
     bool debug_scanner{ false };
     bool debug_parser{ false };
+    // Fold the constant expressions and branches in the AST.
+    bool optimize_ast{ true };
 };
 
 
@@ -21,6 +26,8 @@ class Frontend {
 private:
     ErrorReporter& err_;
     FrontendConfig config_;
+    // First, so that the text outlives the Tokens and the AST.
+    SourceManager sources_;
     Importer importer_;
     Parser parser_;
     Resolver resolver_;
@@ -32,11 +39,12 @@ public:
         FrontendConfig config = { false, false }) :
         err_{ err },
         config_{ config },
-        importer_{ err },
+        importer_{ err, sources_ },
         parser_{ err },
         resolver_{ err }
     {}
 
+    SourceManager& sources() noexcept { return sources_; }
     Importer& importer() noexcept { return importer_; }
     Parser& parser() noexcept { return parser_; }
     Resolver& resolver() noexcept { return resolver_; }
@@ -44,7 +52,9 @@ public:
     FrontendConfig& config() noexcept { return config_; }
     const FrontendConfig& config() const noexcept { return config_; }
 
-    std::span<std::unique_ptr<Stmt>> pass(const std::string& text, std::optional<std::filesystem::path> file = {}) {
+    // The Tokens and the AST view the 'text', it must outlive the Frontend.
+    // Read or add it through the sources(), or pass a string literal.
+    std::span<std::unique_ptr<Stmt>> pass(std::string_view text, std::optional<std::filesystem::path> file = {}) {
         begin_new_pass();
 
         // FIXME: do not rely on reported errors
@@ -85,16 +95,16 @@ public:
             return {};
         }
 
-        tokens = importer().resolve_imports(tokens);
+        auto stream = importer().resolve_imports(std::move(tokens));
 
         if (importer_.has_failed()) {
             has_failed_ = true;
             return {};
         }
 
-        Scanner::append_eof(tokens);
+        Scanner::append_eof(stream);
 
-        auto new_stmts = parser().parse_tokens(tokens);
+        auto new_stmts = parser().parse_tokens(stream);
 
         if (config_.debug_parser) {
             std::cout << "[Debug @Parser]:\n";
@@ -119,6 +129,12 @@ public:
             return {};
         }
 
+        if (config_.optimize_ast) {
+            // The folded nodes go next to the rest.
+            ASTArena::Scope arena_scope{ parser().arena() };
+            ASTOptimizer{}.optimize(new_stmts);
+        }
+
         return new_stmts;
     }
 
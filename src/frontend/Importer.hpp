@@ -6,13 +6,27 @@
 #include "Token.hpp"
 #include "FrontendErrors.hpp"
 #include "Scanner.hpp"
-#include <fstream>
+#include "SourceManager.hpp"
+#include "SourceLocation.hpp"
+#include "TokenStream.hpp"
+#include <boost/container_hash/hash.hpp>
+#include <boost/unordered_set.hpp>
 #include <algorithm>
 #include <filesystem>
-#include <ios>
 #include <iterator>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
 #include <vector>
 #include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#if __has_include(<sys/stat.h>)
+#include <sys/stat.h>
+#define LOX_HAS_POSIX_STAT
+#endif
 
 
 
@@ -20,7 +34,7 @@ class Importer : private ErrorSender<ImporterError> {
 private:
     class ImportResolver : private ErrorSender<ImporterError> {
     private:
-        TokenIterator<std::vector<Token>::const_iterator> state_;
+        TokenIterator<std::span<const Token>::iterator> state_;
         Importer& importer_; // To update and check the list of already imported files
 
     public:
@@ -29,11 +43,9 @@ private:
 
 
         // Try to recursively import starting from the file at path.
+        // Appends the segments of the file, and of everything it imports, to the 'result'.
         // On failure, reports to the ErrorReporter and throws ImporterError::Type.
-        [[nodiscard]]
-        std::vector<Token> try_resolve_imports(std::vector<Token> tokens) {
-            // FIXME: maybe don't copy the tokens but just mutate by ref?
-
+        void try_resolve_imports(std::span<const Token> tokens, TokenStream& result) {
             // Comments here mirror the steps that I've written down
             // in my notebook when trying to wrap my head around the
             // order of operations. Sorry if they seem too redundant.
@@ -41,16 +53,19 @@ private:
 
             // 1 Initialize the TokenIterator state
             state_.reset(tokens.begin(), tokens.end());
+            // Start of the segment that ends with the next import statement.
+            auto segment_begin = state_.current();
 
             // 2. Search for import statements (loop)
             while (!state_.is_end()) {
                 if (state_.match(TokenType::kw_import)) {
                     // 2.5 Parse the import statement and get the file path
                     auto new_file = import_stmt();
+                    auto new_file_key = file_key(new_file);
 
                     // 2.75 Check that the imported file hasn't yet been imported.
                     // Skip it if it was.
-                    if (!importer_.is_already_imported(new_file)) {
+                    if (!importer_.is_already_imported(new_file_key)) {
 
                         // 3. Create an ImportResolver for a new file
                         ImportResolver impres{ error_reporter(), importer_ };
@@ -74,29 +89,17 @@ private:
                         }
 
                         // 3.75 Mark this file as imported
-                        importer_.mark_imported_this_pass(new_file);
+                        importer_.mark_imported_this_pass(new_file, new_file_key);
 
-                        // 4. Resolve imports for the new file
-                        // (recursively calls this function)
-                        auto resolved_tokens =
-                            impres.try_resolve_imports(std::move(new_file_tokens));
-
-                        // 5. Move-insert the result into the token vector
-                        auto it = tokens.insert(
-                            state_.current(), // Points at the token after the import statement
-                            std::make_move_iterator(resolved_tokens.begin()),
-                            std::make_move_iterator(resolved_tokens.end())
-                        );
+                        // 5. End the segment after the import statement,
+                        // the new file goes right after it.
+                        result.add_segment({ segment_begin, state_.current() });
+                        segment_begin = state_.current();
 
-                        // 6. Update iterators (state):
-                        // State is updated after each insertion
-                        // to account for iterator invalidation.
-                        state_.reset(
-                            tokens.begin(),
-                            // New tokens already have their imports resolved
-                            // due to depth-first recursion, skip them.
-                            it + std::ssize(resolved_tokens),
-                            tokens.end()
+                        // 6. Resolve imports for the new file
+                        // (recursively calls this function)
+                        impres.try_resolve_imports(
+                            result.add_file(std::move(new_file_tokens)), result
                         );
 
                     }
@@ -107,7 +110,8 @@ private:
                 }
             }
 
-            return tokens;
+            // 8. The rest of the file after the last import
+            result.add_segment({ segment_begin, state_.end() });
         }
 
 
@@ -134,8 +138,9 @@ private:
 
 
 
-        // Try reading the file at path, abort on failure
-        std::string try_read(const std::filesystem::path& path) {
+        // Try reading the file at path, abort on failure.
+        // The text is retained by the SourceManager of the Importer.
+        std::string_view try_read(const std::filesystem::path& path) {
 
             // Must've skipped past the end of statement:
             // import "file.lox";
@@ -143,19 +148,23 @@ private:
             // So we go back 2 tokens to get the name of the file.
             const Token& path_tok = *(state_.current() - 2);
 
-            if (!std::filesystem::exists(path)) {
+            // One stat for both checks.
+            std::error_code ec;
+            auto status = std::filesystem::status(path, ec);
+
+            if (!std::filesystem::exists(status)) {
                 report_error_and_abort(
                     ImporterError::Type::path_does_not_exist, path_tok, path.string()
                 );
             }
 
-            if (!std::filesystem::is_regular_file(path)) {
+            if (!std::filesystem::is_regular_file(status)) {
                 report_error_and_abort(
                     ImporterError::Type::not_a_regular_file, path_tok, path.string()
                 );
             }
 
-            auto text = read_file(path);
+            auto text = importer_.sources_.read(path);
 
             if (!text.has_value()) {
                 report_error_and_abort(
@@ -163,7 +172,7 @@ private:
                 );
             }
 
-            return std::move(text.value()); // NOLINT: optional checked above, aborts if empty
+            return text.value(); // NOLINT: optional checked above, aborts if empty
         }
 
 
@@ -206,6 +215,46 @@ private:
     }; // class ImportResolver
 
 
+    // Identifies the file itself, not the path to it, so that
+    // different paths to the same file are the same import.
+    struct FileKey {
+        uint64_t device;
+        uint64_t inode;
+
+        bool operator==(const FileKey&) const noexcept = default;
+
+        friend size_t hash_value(const FileKey& key) noexcept {
+            size_t seed{ 0 };
+            boost::hash_combine(seed, key.device);
+            boost::hash_combine(seed, key.inode);
+            return seed;
+        }
+    };
+
+    // A single stat() per import statement. Nothing if the file does not exist,
+    // that is reported later, when it's read.
+    static std::optional<FileKey> file_key(const std::filesystem::path& file) {
+#ifdef LOX_HAS_POSIX_STAT
+        struct stat info{};
+        if (::stat(file.c_str(), &info) != 0) {
+            return {};
+        }
+        return FileKey{ uint64_t(info.st_dev), uint64_t(info.st_ino) };
+#else
+        // No inodes, the canonical path will have to do.
+        std::error_code ec;
+        auto canonical = std::filesystem::canonical(file, ec);
+        if (ec) {
+            return {};
+        }
+        return FileKey{ 0, FileTable::instance().add(canonical) };
+#endif
+    }
+
+
+    // Owns the text of the imported files.
+    SourceManager& sources_;
+
     // A list of all succesfully imported files.
     // Updated each time the call to resolve_imports() succeeds.
     std::vector<std::filesystem::path> imported_files_;
@@ -214,27 +263,43 @@ private:
     // Reset on each invokation of resolve_imports().
     std::vector<std::filesystem::path> imported_this_pass_;
 
+    // The keys of all the files above, the successfully imported
+    // and the ones imported during this call. What is_already_imported() checks.
+    boost::unordered_set<FileKey> imported_keys_;
+
+    // The keys added to the imported_keys_ during this call to resolve_imports(),
+    // and during the last successful one. To take them back out on failure.
+    std::vector<FileKey> keys_this_pass_;
+    std::vector<FileKey> keys_last_pass_;
+
     // A flag indicating whether the last call to resolve_imports() has failed.
     // Reset on each invokation of resolve_imports().
     bool has_failed_{};
 
-    // An iterator pointing to the beginning of the segment,
+    // The index of the beginning of the segment,
     // inserted into the imported_files_ on the last pass.
-    std::vector<std::filesystem::path>::const_iterator last_insertion_point_;
+    size_t last_insertion_point_{};
 
 public:
-    explicit Importer(ErrorReporter& err) : ErrorSender{ err } {}
+    // The imported files are read into the 'sources',
+    // it must outlive the Tokens, and so the Importer.
+    Importer(ErrorReporter& err, SourceManager& sources) :
+        ErrorSender{ err }, sources_{ sources } {}
 
 
+    // The Tokens are not spliced together, nor moved,
+    // the TokenStream keeps them along with the order they go in.
     [[nodiscard("Successful import marks imported files as not reimportable.")]]
-    std::vector<Token> resolve_imports(const std::vector<Token>& tokens) {
+    TokenStream resolve_imports(std::vector<Token> tokens) {
         begin_new_import_pass();
         ImportResolver impres{ error_reporter(), *this };
         try {
-            auto new_tokens = impres.try_resolve_imports(tokens);
+            TokenStream stream;
+            impres.try_resolve_imports(stream.add_file(std::move(tokens)), stream);
             append_imported_this_pass_on_success();
-            return new_tokens;
+            return stream;
         } catch (ImporterError::Type) {
+            forget_keys(keys_this_pass_);
             has_failed_ = true;
             return {};
         }
@@ -242,9 +307,19 @@ public:
 
     // Used by frontend to manually mark the top-level file as imported.
     void mark_imported(std::filesystem::path filepath) {
+        if (auto key = file_key(filepath); key.has_value()) {
+            imported_keys_.insert(key.value());
+        }
         imported_files_.emplace_back(std::move(filepath));
     }
 
+    // All files imported so far, including the top-level one.
+    // The paths are the way they were written in the import statements,
+    // relative to the directory of the top-level file.
+    const std::vector<std::filesystem::path>& imported_files() const noexcept {
+        return imported_files_;
+    }
+
     // Validate that the last call to resolve_imports() succeded.
     bool has_failed() const noexcept { return has_failed_; }
 
@@ -254,70 +329,55 @@ public:
     //
     // Repeated calls will not erase any more elements.
     void undo_last_successful_pass() {
-        last_insertion_point_ = imported_files_.erase(last_insertion_point_, imported_files_.cend());
-    }
-
-
-    static std::optional<std::string> read_file(const std::filesystem::path& file) {
-
-        std::ifstream fs{ file };
-
-        if (!fs.fail()) {
-            try {
-                return std::string{
-                    std::istreambuf_iterator<char>(fs),
-                    std::istreambuf_iterator<char>()
-                };
-            } catch (std::ios_base::failure& e) {
-                // return nullopt;
-            }
-        }
-        return {};
+        last_insertion_point_ = std::min(last_insertion_point_, imported_files_.size());
+        imported_files_.resize(last_insertion_point_);
+        forget_keys(keys_last_pass_);
     }
 
 
-
-
 private:
     // Checked by ImportResolver to prevent repeating or circular imports.
-    bool is_already_imported(const std::filesystem::path& file) const {
-
-        auto is_same_file = [&file](const std::filesystem::path& other) {
-            return std::filesystem::equivalent(file, other);
-        };
-
-        return std::any_of(
-            imported_files_.begin(),
-            imported_files_.end(),
-            is_same_file
-        ) || std::any_of(
-            imported_this_pass_.begin(),
-            imported_this_pass_.end(),
-            is_same_file
-        );
+    // A file without a key does not exist, it can't have been imported.
+    bool is_already_imported(const std::optional<FileKey>& key) const {
+        return key.has_value() && imported_keys_.contains(key.value());
     }
 
     // Marked by ImportResolver upon reading a file.
-    void mark_imported_this_pass(const std::filesystem::path& file) {
+    void mark_imported_this_pass(const std::filesystem::path& file, const std::optional<FileKey>& key) {
         imported_this_pass_.emplace_back(file);
+        if (key.has_value() && imported_keys_.insert(key.value()).second) {
+            keys_this_pass_.push_back(key.value());
+        }
     }
 
     // Called on each invokation of resolve_imports().
     // Resets the per-call state.
     void begin_new_import_pass() {
         imported_this_pass_.clear();
+        keys_this_pass_.clear();
         has_failed_ = false;
     }
 
+    // Makes the files importable again.
+    void forget_keys(std::vector<FileKey>& keys) {
+        for (const auto& key : keys) {
+            imported_keys_.erase(key);
+        }
+        keys.clear();
+    }
+
 
     // If the top level call to try_resolve_imports() succeeds, then append the files
     // imported during the call to the list of all imported files.
     void append_imported_this_pass_on_success() {
-        last_insertion_point_ = imported_files_.insert(
+        last_insertion_point_ = imported_files_.size();
+        imported_files_.insert(
             imported_files_.end(),
             std::make_move_iterator(imported_this_pass_.begin()),
             std::make_move_iterator(imported_this_pass_.end())
         );
+        keys_last_pass_ = std::move(keys_this_pass_);
+        keys_this_pass_.clear();
     }
 
 };
@@ -2,12 +2,14 @@
 #include "ErrorReporter.hpp"
 #include "FrontendErrors.hpp"
 #include "ErrorSender.hpp"
+#include "ASTArena.hpp"
 #include "CommonVisitors.hpp"
 #include "Expr.hpp"
 #include "Stmt.hpp"
 #include "Token.hpp"
 #include "TokenType.hpp"
 #include "TokenIterator.hpp"
+#include "TokenStream.hpp"
 #include <concepts>
 #include <vector>
 #include <cassert>
@@ -19,10 +21,12 @@
 
 class Parser : private ErrorSender<ParserError> {
 private:
+    // Declared first, outlives the statements.
+    ASTArena arena_;
     std::vector<std::unique_ptr<Stmt>> statements_;
-    TokenIterator<std::vector<Token>::const_iterator> state_;
+    TokenIterator<TokenStream::const_iterator> state_;
 
-    void prepare_tokens(const std::vector<Token>& new_tokens) {
+    void prepare_tokens(const TokenStream& new_tokens) {
         state_.reset(new_tokens.begin(), new_tokens.end());
     }
 
@@ -32,8 +36,9 @@ public:
 
     // returns a view of new statements
     std::span<std::unique_ptr<Stmt>>
-    parse_tokens(const std::vector<Token>& tokens) {
+    parse_tokens(const TokenStream& tokens) {
         prepare_tokens(tokens);
+        ASTArena::Scope arena_scope{ arena_ };
 
         auto num_stmts_before = std::ssize(statements_);
 
@@ -56,6 +61,7 @@ public:
         return statements_;
     }
 
+    // The nodes stay in the arena of the Parser, it must outlive them.
     [[nodiscard]] std::vector<std::unique_ptr<Stmt>> get_result() {
         assert(is_eof());
         state_.reset();
@@ -66,6 +72,9 @@ public:
         return state_.is_eof();
     }
 
+    // Where the nodes of the parsed statements are allocated.
+    ASTArena& arena() noexcept { return arena_; }
+
 
 
 
@@ -15,21 +15,9 @@ void ResolveVisitor::resolve(const Stmt& stmt) const {
     stmt.accept(*this);
 }
 
-// I'm tired, forgive me for the next 2 functions
+// I'm tired, forgive me for the next function
 
-size_t ResolveVisitor::distance_to_enclosing_fun_scope() const {
-    size_t num_scopes{ resolver_.scopes().size() };
-
-    size_t i{ 0 };
-    for (; i < num_scopes; ++i) {
-        if (resolver_.scope_types()[num_scopes - 1 - i] == ScopeType::function) {
-            return i;
-        }
-    }
-    return i; // i == num_scopes
-}
-
-size_t ResolveVisitor::distance_to_var_decl(const std::string& name) const {
+size_t ResolveVisitor::distance_to_var_decl(std::string_view name) const {
     size_t num_scopes{ resolver_.scopes().size() };
 
     size_t i{ 0 };
@@ -42,18 +30,45 @@ size_t ResolveVisitor::distance_to_var_decl(const std::string& name) const {
 }
 
 
-void ResolveVisitor::resolve_local(const Expr& expr, const std::string& name) const {
+Binding ResolveVisitor::resolve_local(const Expr& expr, std::string_view name) const {
 
+    size_t num_scopes{ resolver_.scopes().size() };
     size_t lexical_distance{ distance_to_var_decl(name) };
 
-    if (lexical_distance < resolver_.scopes().size()) { // Validate that it's declared at all
-
-        size_t would_be_closure_distance{ distance_to_enclosing_fun_scope() + 1 };
+    if (lexical_distance < num_scopes) { // Validate that it's declared at all
+
+        // Where the variable can be found at runtime:
+        // either in the scope that declares it, or, if the reference
+        // is inside of a function nested in that scope, in the closure
+        // of the function. Closures of the functions in between capture
+        // the variable from each other, from the outermost inwards.
+        size_t target_idx{ num_scopes - 1 - lexical_distance };
+        uint32_t slot{
+            static_cast<uint32_t>(resolver_.scope_at(target_idx).at(name).slot)
+        };
+        bool in_closure{ false };
+
+        // The closure Environment encloses the Environment of the function body.
+        // Outside of functions the global scope is reachable directly.
+        auto binding_from = [&](size_t scope_idx) -> Binding {
+            if (target_idx == 0 && !in_closure) {
+                return { 0, slot, Binding::Kind::global };
+            }
+            return {
+                static_cast<uint32_t>(scope_idx - target_idx + (in_closure ? 1 : 0)),
+                slot, Binding::Kind::local
+            };
+        };
+
+        for (size_t idx{ target_idx + 1 }; idx < num_scopes; ++idx) {
+            if (resolver_.scope_types()[idx] == ScopeType::function) {
+                slot = resolver_.capture(idx, name, binding_from(idx - 1));
+                target_idx = idx;
+                in_closure = true;
+            }
+        }
 
-        // If we're within the scope of the same function, then it's local to it's body.
-        // Otherwise, look in the closure of that fucntion.
-        size_t real_distance = std::min(lexical_distance, would_be_closure_distance);
-        resolver_.set_depth(expr, real_distance);
+        return binding_from(num_scopes - 1);
 
     } else /* not resolved */ {
 
@@ -61,8 +76,9 @@ void ResolveVisitor::resolve_local(const Expr& expr, const std::string& name) co
             ResolverError::Type::undefined_variable,
             expr.accept(ExprGetPrimaryTokenVisitor{}),
             name_of(expr),
-            name
+            std::string(name)
         );
+        return {};
     }
 }
 
@@ -70,27 +86,32 @@ void ResolveVisitor::resolve_local(const Expr& expr, const std::string& name) co
 
 void ResolveVisitor::resolve_function(const FunStmt& stmt) const {
     resolver_.push_scope(ScopeType::function);
+    // Slot 0 is reserved for the function itself, for recursion.
+    resolver_.define_function_name(stmt.name.lexeme());
     for (const Token& param : stmt.parameters) {
-        resolver_.declare(param.lexeme());
-        resolver_.define(param.lexeme());
+        if (try_declare(Stmt::from_alternative(stmt), param)) {
+            resolver_.define(param.lexeme());
+        }
     }
     for (const auto& statement : stmt.body) {
         resolve(*statement);
     }
+    stmt.num_slots = resolver_.num_top_scope_slots();
+    stmt.captures = resolver_.take_top_scope_captures();
     resolver_.pop_scope();
 }
 
-bool ResolveVisitor::try_declare(const VarStmt& stmt, const std::string& name) const {
-    bool success{ resolver_.declare(name) };
-    if (!success) {
+std::optional<size_t> ResolveVisitor::try_declare(const Stmt& stmt, const Token& name) const {
+    auto slot = resolver_.declare(name.lexeme());
+    if (!slot) {
         resolver_.send_error(
             ResolverError::Type::local_variable_redeclaration,
-            stmt.identifier,
-            name_of(Stmt::from_alternative(stmt)),
-            name
+            name,
+            name_of(stmt),
+            std::string(name.lexeme())
         );
     }
-    return success;
+    return slot;
 }
 
 
@@ -122,7 +143,7 @@ void ResolveVisitor::operator()(const VariableExpr& expr) const {
 
     if (!resolver_.is_in_global_scope()) {
         auto it = resolver_.top_scope().find(expr.identifier.lexeme());
-        if (it != resolver_.top_scope().end() && it->second == ResolveState::declared) {
+        if (it != resolver_.top_scope().end() && it->second.state == ResolveState::declared) {
             resolver_.send_error(
                 ResolverError::Type::initialization_from_self,
                 expr.identifier,
@@ -132,12 +153,12 @@ void ResolveVisitor::operator()(const VariableExpr& expr) const {
         }
     }
 
-    resolve_local(expr, expr.identifier.lexeme());
+    expr.binding = resolve_local(expr, expr.identifier.lexeme());
 }
 
 void ResolveVisitor::operator()(const AssignExpr& expr) const {
     resolve(*expr.rvalue);
-    resolve_local(expr, expr.identifier.lexeme());
+    expr.binding = resolve_local(expr, expr.identifier.lexeme());
 }
 
 void ResolveVisitor::operator()(const LogicalExpr& expr) const {
@@ -167,7 +188,8 @@ void ResolveVisitor::operator()(const ExpressionStmt& stmt) const {
 }
 
 void ResolveVisitor::operator()(const VarStmt& stmt) const {
-    if (try_declare(stmt, stmt.identifier.lexeme())) {
+    if (auto slot = try_declare(Stmt::from_alternative(stmt), stmt.identifier)) {
+        stmt.slot = *slot;
         resolve(*stmt.init);
         resolver_.define(stmt.identifier.lexeme());
     }
@@ -178,6 +200,7 @@ void ResolveVisitor::operator()(const BlockStmt& stmt) const {
     for (const auto& statement : stmt.statements) {
         resolve(*statement);
     }
+    stmt.num_slots = resolver_.num_top_scope_slots();
     resolver_.pop_scope();
 }
 
@@ -193,8 +216,10 @@ void ResolveVisitor::operator()(const WhileStmt& stmt) const {
 }
 
 void ResolveVisitor::operator()(const FunStmt& stmt) const {
-    resolver_.declare(stmt.name.lexeme());
-    resolver_.define(stmt.name.lexeme());
+    if (auto slot = try_declare(Stmt::from_alternative(stmt), stmt.name)) {
+        stmt.slot = *slot;
+        resolver_.define(stmt.name.lexeme());
+    }
     resolve_function(stmt);
 }
 
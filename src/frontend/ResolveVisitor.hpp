@@ -1,6 +1,8 @@
 #pragma once
 #include "Expr.hpp"
 #include "Stmt.hpp"
+#include <optional>
+#include <string_view>
 
 
 
@@ -41,14 +43,13 @@ public:
 
 private:
     void resolve(const Expr& expr) const;
-    void resolve_local(const Expr& expr, const std::string& name) const;
+    Binding resolve_local(const Expr& expr, std::string_view name) const;
 
     void resolve(const Stmt& stmt) const;
     void resolve_function(const FunStmt& stmt) const;
 
-    bool try_declare(const VarStmt& stmt, const std::string& name) const;
+    std::optional<size_t> try_declare(const Stmt& stmt, const Token& name) const;
 
-    size_t distance_to_var_decl(const std::string& name) const;
-    size_t distance_to_enclosing_fun_scope() const;
+    size_t distance_to_var_decl(std::string_view name) const;
 
 };
@@ -4,12 +4,16 @@
 #include "ErrorSender.hpp"
 #include "FrontendErrors.hpp"
 #include "ErrorReporter.hpp"
+#include "Token.hpp"
 #include <memory>
 #include <vector>
 #include <stack>
 #include <boost/unordered_map.hpp>
 #include <string>
+#include <string_view>
 #include <span>
+#include <optional>
+#include <cstdint>
 
 class Expr;
 
@@ -36,13 +40,35 @@ enum class ScopeType {
 };
 
 
+// Each declared name gets a slot in the scope it's declared in.
+// At runtime, every scope maps onto a single Environment,
+// where the slot is an index into it's flat storage.
+struct ResolvedName {
+    ResolveState state;
+    size_t slot;
+    // The name of the function itself, visible from it's own body.
+    // Can be shadowed by parameters or locals of the same name.
+    bool is_function_name{ false };
+};
+
+// The names are the views of the lexemes, interned
+// on insertion, see Resolver::key_of().
+struct Scope {
+    boost::unordered_map<std::string_view, ResolvedName> names;
+    size_t num_slots{ 0 };
+    // Function scopes only. Variables from the enclosing scopes
+    // referenced in the function body, each gets a slot in the closure.
+    boost::unordered_map<std::string_view, uint32_t> capture_slots;
+    std::vector<Binding> captures;
+};
+
+
 
 class Resolver : private ErrorSender<ResolverError> {
 public:
-    using map_t = boost::unordered_map<std::string, ResolveState>;
-    using scope_stack_t = std::vector<map_t>;
+    using map_t = boost::unordered_map<std::string_view, ResolvedName>;
+    using scope_stack_t = std::vector<Scope>;
     using scope_type_stack_t = std::vector<ScopeType>;
-    using depth_map_t = boost::unordered_map<const Expr*, size_t>;
 
 private:
     friend ResolveVisitor;
@@ -50,11 +76,9 @@ private:
 
     scope_stack_t scope_stack_;
     scope_type_stack_t scope_type_stack_;
-    depth_map_t depth_map_;
 
-    // Hacky but eeeh
-    bool is_in_function_prev_{ false };
-    bool is_in_function_{ false };
+    // Number of function scopes on the scope stack.
+    size_t function_depth_{ 0 };
 
 public:
     Resolver(ErrorReporter& err) :
@@ -71,8 +95,7 @@ public:
 
     void push_scope(ScopeType type) {
         if (type == ScopeType::function) {
-            is_in_function_prev_ = is_in_function_;
-            is_in_function_ = true;
+            ++function_depth_;
         }
 
         scope_type_stack_.emplace_back(type);
@@ -81,7 +104,7 @@ public:
 
     void pop_scope() {
         if (top_scope_type() == ScopeType::function) {
-            is_in_function_ = is_in_function_prev_;
+            --function_depth_;
         }
 
         scope_type_stack_.pop_back();
@@ -89,7 +112,7 @@ public:
     }
 
     map_t& top_scope() {
-        return scope_stack_.back();
+        return scope_stack_.back().names;
     }
 
     ScopeType& top_scope_type() {
@@ -102,7 +125,7 @@ public:
 
 
     map_t& scope_at(size_t idx) {
-        return scope_stack_[idx];
+        return scope_stack_[idx].names;
     }
 
     scope_stack_t& scopes() {
@@ -119,32 +142,80 @@ public:
         return top_scope_type() == ScopeType::global;
     }
 
-    bool declare(const std::string& name) {
-        if (top_scope().contains(name) && !is_in_global_scope()) {
-            return false;
+    // Returns the slot of the declared name on success.
+    //
+    // Redeclaration in the global scope reuses the slot
+    // of the previous declaration.
+    std::optional<size_t> declare(std::string_view name) {
+        auto it = top_scope().find(name);
+        if (it != top_scope().end()) {
+            if (is_in_global_scope()) {
+                it->second.state = ResolveState::declared;
+                return it->second.slot;
+            }
+            if (!it->second.is_function_name) {
+                return std::nullopt;
+            }
         }
-        top_scope()[name] = ResolveState::declared;
-        return true;
+        size_t slot{ scope_stack_.back().num_slots++ };
+        top_scope().insert_or_assign(key_of(name), ResolvedName{ ResolveState::declared, slot });
+        return slot;
     }
 
-    void define(const std::string& name) {
+    void define(std::string_view name) {
         assert(top_scope().find(name) != top_scope().end());
-        assert(top_scope().find(name)->second == ResolveState::declared);
-        top_scope()[name] = ResolveState::defined;
+        assert(top_scope().find(name)->second.state == ResolveState::declared);
+        top_scope().at(name).state = ResolveState::defined;
+    }
+
+    // Called right after pushing the function scope.
+    // Occupies the first slot of the function's Environment.
+    void define_function_name(std::string_view name) {
+        assert(top_scope_type() == ScopeType::function);
+        assert(scope_stack_.back().num_slots == 0);
+        size_t slot{ scope_stack_.back().num_slots++ };
+        top_scope().insert_or_assign(key_of(name), ResolvedName{ ResolveState::defined, slot, true });
     }
 
+    size_t num_global_slots() const noexcept {
+        return scope_stack_.front().num_slots;
+    }
+
+    size_t num_top_scope_slots() const noexcept {
+        return scope_stack_.back().num_slots;
+    }
 
-    void set_depth(const Expr& expr, size_t depth) {
-        depth_map_[&expr] = depth;
+    // Adds the name to the closure of the function scope at 'idx',
+    // unless it's already captured. The 'source' locates the variable
+    // from the scope where the function is declared (idx - 1).
+    //
+    // Returns the slot of the variable in the closure.
+    uint32_t capture(size_t idx, std::string_view name, Binding source) {
+        assert(scope_type_stack_[idx] == ScopeType::function);
+        Scope& scope{ scope_stack_[idx] };
+        if (auto it = scope.capture_slots.find(name); it != scope.capture_slots.end()) {
+            return it->second;
+        }
+        auto slot = static_cast<uint32_t>(scope.captures.size());
+        scope.capture_slots.emplace(key_of(name), slot);
+        scope.captures.emplace_back(source);
+        return slot;
     }
 
-    depth_map_t& depth_map() {
-        return depth_map_;
+    std::vector<Binding> take_top_scope_captures() noexcept {
+        return std::move(scope_stack_.back().captures);
     }
 
 
     bool is_in_function() const noexcept {
-        return is_in_function_;
+        return function_depth_ != 0;
+    }
+
+private:
+    // The names can come from anywhere, not only from the Tokens,
+    // so the keys are interned to outlive the scopes.
+    static std::string_view key_of(std::string_view name) {
+        return LexemeTable::instance().intern(name);
     }
 
 };
@@ -1,14 +1,18 @@
 #pragma once
 #include "Token.hpp"
 #include "TokenType.hpp"
+#include "TokenStream.hpp"
 #include "FrontendErrors.hpp"
 #include "ErrorSender.hpp"
 #include "ErrorReporter.hpp"
+#include "CharScan.hpp"
+#include <charconv>
 #include <filesystem>
 #include <vector>
 #include <string>
 #include <string_view>
 #include <cassert>
+#include <cstdint>
 #include <utility>
 
 
@@ -16,20 +20,25 @@ class Scanner : private ErrorSender<ScannerError> {
 private:
     class ScannerState {
     public:
-        using iter_t = std::string::const_iterator;
+        // Straight into the buffer of the source text.
+        using iter_t = const char*;
     private:
-        iter_t beg_;
-        iter_t cur_;
-        iter_t token_beg_;
-        iter_t end_;
-        SourceLocation location_{ 0, 0 };
+        iter_t beg_{};
+        iter_t cur_{};
+        iter_t token_beg_{};
+        iter_t end_{};
+        // The column is not counted character by character,
+        // it's the distance from the beginning of the line.
+        iter_t line_beg_{};
+        uint16_t line_{ 0 };
+        FileTable::Id file_{ FileTable::no_file };
 
     public:
         ScannerState() = default;
 
-        ScannerState(iter_t beg, iter_t end, SourceLocation location) :
+        ScannerState(iter_t beg, iter_t end, FileTable::Id file) :
             beg_{ beg }, cur_{ beg }, end_{ end },
-            location_{ std::move(location) }
+            line_beg_{ beg }, line_{ 1 }, file_{ file }
         {}
 
         bool is_end() const noexcept { return cur_ == end_; }
@@ -57,10 +66,16 @@ private:
 
         char advance() noexcept {
             assert(!is_end());
-            add_column();
             return *cur_++;
         }
 
+        // Past the run found by one of the char_scan functions.
+        // There must be no newlines in it.
+        void skip_to(iter_t pos) noexcept {
+            assert(cur_ <= pos && pos <= end_);
+            cur_ = pos;
+        }
+
         bool match(char expected) noexcept {
             if (is_end()) return false;
 
@@ -72,18 +87,15 @@ private:
             }
         }
 
-        const SourceLocation& location() const noexcept { return location_; }
+        SourceLocation location() const noexcept {
+            return { line_, static_cast<uint16_t>(cur_ - line_beg_ + 1), file_ };
+        }
 
 
+        // Call right after advancing past the newline.
         void add_line() noexcept {
-            ++location_.line;
-            reset_column();
-        }
-        void add_column() noexcept {
-            ++location_.column;
-        }
-        void reset_column() noexcept {
-            location_.column = 1;
+            ++line_;
+            line_beg_ = cur_;
         }
 
         // Call each time before scanning the next token
@@ -99,22 +111,11 @@ private:
     ScannerState state_;
     bool did_produce_error_{};
 
-    void prepare_source(const std::string& text, const std::filesystem::path& file) {
-        state_ = {
-            text.cbegin(), text.cend(),
-            SourceLocation{
-                 1, 1,
-                 std::make_shared<std::filesystem::path>(std::filesystem::canonical(file))
-                }
-        };
-        did_produce_error_ = false;
-    }
-
-    void prepare_source(const std::string& text) {
-        state_ = {
-            text.cbegin(), text.cend(),
-            { 1, 1 }
-        };
+    void prepare_source(std::string_view text, FileTable::Id file) {
+        state_ = { text.data(), text.data() + text.size(), file };
+        // About a token per 3-4 characters in the usual code.
+        // Saves copying the tokens over while the vector grows.
+        tokens_.reserve(text.size() / 4);
         did_produce_error_ = false;
     }
 
@@ -122,12 +123,14 @@ private:
 public:
     Scanner(ErrorReporter& err) : ErrorSender{ err } {}
 
+    // The Tokens view their lexemes in the 'source_text', it must outlive them.
+    // Keep it in the SourceManager, or make it a string literal.
     [[nodiscard]]
-    std::vector<Token> scan_tokens(const std::string& source_text, const std::filesystem::path& file) {
+    std::vector<Token> scan_tokens(std::string_view source_text, const std::filesystem::path& file) {
         // It's your job to check that 'source_text' comes from 'file'.
         // Otherwise, things can become awkward.
 
-        prepare_source(source_text, file);
+        prepare_source(source_text, FileTable::instance().add(std::filesystem::canonical(file)));
 
         while (!state_.is_end()) {
             state_.new_token();
@@ -144,8 +147,8 @@ public:
     }
 
     [[nodiscard]]
-    std::vector<Token> scan_tokens(const std::string& source_text) {
-        prepare_source(source_text);
+    std::vector<Token> scan_tokens(std::string_view source_text) {
+        prepare_source(source_text, FileTable::no_file);
         while (!state_.is_end()) {
             state_.new_token();
             scan_token();
@@ -153,33 +156,53 @@ public:
         return std::move(tokens_);
     }
 
+    // A string literal lives for the whole run.
+    template<size_t N>
+    [[nodiscard]]
+    std::vector<Token> scan_tokens(const char (&source_text)[N]) {
+        return scan_tokens(std::string_view{ source_text, N - 1 });
+    }
+
+    // A temporary string would be gone before the Tokens viewing it.
+    std::vector<Token> scan_tokens(std::string&&, const std::filesystem::path&) = delete;
+    std::vector<Token> scan_tokens(std::string&&) = delete;
+
     bool has_failed() const noexcept { return did_produce_error_; }
 
     // Append a special symbol that tells the Parser
     // to stop parsing. Will preserve source location information.
     static void append_eof(std::vector<Token>& tokens) {
+        tokens.emplace_back(eof_after(tokens.empty() ? nullptr : &tokens.back()));
+    }
+
+    // Same, for the Tokens with the imports resolved.
+    static void append_eof(TokenStream& tokens) {
+        tokens.add_segment(
+            tokens.add_file({ eof_after(tokens.empty() ? nullptr : &tokens.back()) })
+        );
+    }
+
+
+private:
+    static Token eof_after(const Token* last) {
         SourceLocation location{0, 0};
-        if (!tokens.empty()) {
-            location = tokens.back().location();
+        if (last) {
+            location = last->location();
             // FIXME: ermm, are we pointing at the beginning
             // or the end of the token? I think it was the end...
             // The next line is kina wrong then, but shouldn't
             // break anything.
-            location.column += tokens.back().lexeme().size();
+            location.column += last->lexeme().size();
         }
 
-        tokens.emplace_back(
-            Token{
-                TokenType::eof,
-                to_lexeme(TokenType::eof),
-                location,
-                {}
-            }
-        );
+        return Token{
+            TokenType::eof,
+            to_lexeme(TokenType::eof),
+            location,
+            {}
+        };
     }
 
-
-private:
     void scan_token() noexcept {
 
         using enum TokenType;
@@ -212,9 +235,12 @@ private:
             case ' ':
             case '\r':
             case '\t':
+                skip_blanks();
                 break;
             case '\n':
                 state_.add_line();
+                // Most likely followed by the indentation.
+                skip_blanks();
                 break;
             case '"':
                 add_string_literal_token();
@@ -236,8 +262,13 @@ private:
     }
 
     void skip_singleline_comment() {
-        while (!state_.is_end() && state_.peek() != '\n') {
-            state_.advance();
+        state_.skip_to(char_scan::find_line_end(state_.current(), state_.end()));
+    }
+
+    // Most of the runs are a single space, skip those without the call.
+    void skip_blanks() {
+        if (!state_.is_end() && is_blank(state_.peek())) {
+            state_.skip_to(char_scan::skip_blanks(state_.current(), state_.end()));
         }
     }
 
@@ -266,18 +297,18 @@ private:
     }
 
 
-    void add_token(TokenType type) {
-        tokens_.emplace_back(type, std::string(state_.lexeme()), state_.location());
-    }
-
-    void add_token(TokenType type, LiteralValue&& literal) {
-        tokens_.emplace_back(type, std::string(state_.lexeme()), state_.location(), std::move(literal));
+    void add_token(TokenType type, uint32_t literal_id = LiteralTable::none) {
+        tokens_.push_back(
+            Token::from_source(type, state_.lexeme(), state_.location(), literal_id)
+        );
     }
 
     void add_string_literal_token() {
+        state_.skip_to(char_scan::find_quote_or_line_end(state_.current(), state_.end()));
         while (!state_.is_end() && state_.peek() != '"') {
-            if (state_.peek() == '\n') state_.add_line();
-            state_.advance();
+            state_.advance(); // past the newline
+            state_.add_line();
+            state_.skip_to(char_scan::find_quote_or_line_end(state_.current(), state_.end()));
         }
 
         if (state_.is_end()) {
@@ -293,7 +324,7 @@ private:
 
         add_token(
             TokenType::string,
-            String(quoted_literal.substr(1, quoted_literal.size() - 2))
+            LiteralTable::instance().add_string(quoted_literal.substr(1, quoted_literal.size() - 2))
         );
     }
 
@@ -320,30 +351,27 @@ private:
             }
         }
 
-        add_token(
-            TokenType::number,
-            std::stod(std::string(state_.lexeme()))
-        );
+        std::string_view lexeme{ state_.lexeme() };
+        Number value{};
+        std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+        add_token(TokenType::number, LiteralTable::instance().add(value));
     }
 
     void add_identifier_token() {
-        while (!state_.is_end() && is_alphanum(state_.peek())) {
-            state_.advance();
+        // Same as with the blanks, there's a lot of one letter names.
+        if (!state_.is_end() && is_alphanum(state_.peek())) {
+            state_.skip_to(char_scan::skip_identifier(state_.current(), state_.end()));
         }
 
-        auto it = detail::keyword_map.find(std::string(state_.lexeme()));
-        if (it != detail::keyword_map.end()) {
-            if (it->second == TokenType::kw_true) {
-                add_token(it->second, true);
-            } else if (it->second == TokenType::kw_false) {
-                add_token(it->second, false);
-            } else if (it->second == TokenType::kw_nil) {
-                add_token(it->second, Nil{});
-            } else {
-                add_token(it->second);
-            }
+        TokenType type{ keyword_or_identifier(state_.lexeme()) };
+        if (type == TokenType::kw_true) {
+            add_token(type, LiteralTable::true_id);
+        } else if (type == TokenType::kw_false) {
+            add_token(type, LiteralTable::false_id);
+        } else if (type == TokenType::kw_nil) {
+            add_token(type, LiteralTable::nil_id);
         } else {
-            add_token(TokenType::identifier);
+            add_token(type);
         }
     }
 
@@ -356,6 +384,10 @@ private:
 
 
 private:
+    static bool is_blank(char c) noexcept {
+        return c == ' ' || c == '\r' || c == '\t';
+    }
+
     static bool is_digit(char c) noexcept {
         return c >= '0' && c <= '9';
     }
@@ -0,0 +1,100 @@
+#pragma once
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if __has_include(<unistd.h>)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOX_HAS_POSIX_READ
+#endif
+
+
+// Owns the text of every source that went through the Frontend:
+// the files, and the lines of the prompt.
+//
+// The Scanner does not copy the lexemes out of the text,
+// the Tokens view them in place, see Token::from_source().
+// The buffers are never released or moved, so the Tokens
+// and the AST stay valid for as long as the SourceManager.
+class SourceManager {
+private:
+    // Deque, so that the strings themselves never move.
+    // (Moving a short string would move it's characters too)
+    std::deque<std::string> buffers_;
+
+public:
+    SourceManager() = default;
+    SourceManager(const SourceManager&) = delete;
+    SourceManager& operator=(const SourceManager&) = delete;
+
+    // Retains the 'text', the view is valid for the lifetime of the SourceManager.
+    std::string_view add(std::string text) {
+        return buffers_.emplace_back(std::move(text));
+    }
+
+    // Reads and retains the whole file. Nothing if it could not be read.
+    std::optional<std::string_view> read(const std::filesystem::path& file) {
+        auto text = read_file(file);
+        if (!text.has_value()) {
+            return {};
+        }
+        return add(std::move(text.value()));
+    }
+
+    size_t num_buffers() const noexcept { return buffers_.size(); }
+
+
+    // Reads the whole file with a single read() into a buffer
+    // of the right size, not character by character.
+    static std::optional<std::string> read_file(const std::filesystem::path& file) {
+#ifdef LOX_HAS_POSIX_READ
+        int fd{ ::open(file.c_str(), O_RDONLY) };
+        if (fd < 0) {
+            return {};
+        }
+        struct stat info{};
+        if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            ::close(fd);
+            return {};
+        }
+
+        std::string text;
+        text.resize(size_t(info.st_size));
+        size_t num_read{ 0 };
+        // A single call, unless it's interrupted or the file has grown short.
+        while (num_read < text.size()) {
+            ssize_t result{ ::read(fd, text.data() + num_read, text.size() - num_read) };
+            if (result < 0) {
+                ::close(fd);
+                return {};
+            }
+            if (result == 0) {
+                text.resize(num_read);
+                break;
+            }
+            num_read += size_t(result);
+        }
+        ::close(fd);
+        return text;
+#else
+        std::ifstream fs{ file, std::ios::binary | std::ios::ate };
+        if (fs.fail()) {
+            return {};
+        }
+        std::string text;
+        text.resize(size_t(fs.tellg()));
+        fs.seekg(0);
+        if (!fs.read(text.data(), std::streamsize(text.size()))) {
+            return {};
+        }
+        return text;
+#endif
+    }
+};
@@ -2,15 +2,19 @@
 #include "Token.hpp"
 #include <vector>
 #include <concepts>
+#include <iterator>
 
 
 // A general purpose utility for walking a range of Tokens.
 // (What once was a ParserState)
+//
+// Steps one Token at a time, so the range doesn't have to be contiguous,
+// the Parser walks the segments of a TokenStream.
 
-template<typename RandomIt>
+template<std::bidirectional_iterator Iter>
 class TokenIterator {
 public:
-    using iter_t = RandomIt;
+    using iter_t = Iter;
 private:
     iter_t beg_;
     iter_t cur_;
@@ -42,7 +46,7 @@ public:
 
     bool is_begin() const noexcept { return cur_ == beg_; }
 
-    bool is_next_end() const noexcept { return cur_ + 1 == end_; }
+    bool is_next_end() const noexcept { return next() == end_; }
 
     iter_t begin() const noexcept { return beg_; }
 
@@ -50,9 +54,9 @@ public:
 
     iter_t current() const noexcept { return cur_; }
 
-    iter_t previous() const noexcept { return cur_ - 1; }
+    iter_t previous() const noexcept { return std::prev(cur_); }
 
-    iter_t next() const noexcept { return cur_ + 1; }
+    iter_t next() const noexcept { return std::next(cur_); }
 
     const Token& peek_previous() const noexcept {
         assert(!is_begin());
@@ -0,0 +1,135 @@
+#pragma once
+#include "Token.hpp"
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+// The Tokens of a pass with the imports resolved, in the order
+// the Parser reads them, without splicing the files together.
+//
+// Owns the Tokens of every file, and keeps a list of spans over them.
+// An import statement ends a span, the spans of the imported file follow,
+// then the rest of the importing file picks up where it left off.
+class TokenStream {
+private:
+    // The buffers of the vectors stay in place when the outer one grows,
+    // the spans keep pointing to them.
+    std::vector<std::vector<Token>> files_;
+    // Never empty ones, so that an iterator never rests at the end of one.
+    std::vector<std::span<const Token>> segments_;
+
+public:
+    // Walks the segments one after another.
+    class const_iterator {
+    public:
+        using iterator_concept = std::bidirectional_iterator_tag;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Token;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Token*;
+        using reference = const Token&;
+
+    private:
+        using segment_t = std::span<const Token>;
+
+        const segment_t* seg_{};
+        const segment_t* last_seg_{};
+        const Token* cur_{};
+        // Cached end of the current segment.
+        const Token* seg_end_{};
+
+    public:
+        const_iterator() = default;
+
+        const_iterator(const segment_t* seg, const segment_t* last_seg, const Token* cur) :
+            seg_{ seg }, last_seg_{ last_seg }, cur_{ cur },
+            seg_end_{ seg->data() + seg->size() }
+        {}
+
+        reference operator*() const noexcept { return *cur_; }
+
+        pointer operator->() const noexcept { return cur_; }
+
+        const_iterator& operator++() noexcept {
+            if (++cur_ == seg_end_ && seg_ != last_seg_) {
+                ++seg_;
+                cur_ = seg_->data();
+                seg_end_ = cur_ + seg_->size();
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) noexcept {
+            auto copy{ *this };
+            ++*this;
+            return copy;
+        }
+
+        const_iterator& operator--() noexcept {
+            if (cur_ == seg_->data()) {
+                --seg_;
+                seg_end_ = seg_->data() + seg_->size();
+                cur_ = seg_end_;
+            }
+            --cur_;
+            return *this;
+        }
+
+        const_iterator operator--(int) noexcept {
+            auto copy{ *this };
+            --*this;
+            return copy;
+        }
+
+        // The end of one file and the beginning of the next
+        // import may be the same address, compare the segments too.
+        bool operator==(const const_iterator& other) const noexcept {
+            return cur_ == other.cur_ && seg_ == other.seg_;
+        }
+    };
+
+
+    TokenStream() = default;
+
+    // Takes the Tokens of a file, for the segments to view.
+    std::span<const Token> add_file(std::vector<Token> tokens) {
+        return files_.emplace_back(std::move(tokens));
+    }
+
+    // Appends the next piece of one of the files.
+    void add_segment(std::span<const Token> tokens) {
+        if (!tokens.empty()) {
+            segments_.push_back(tokens);
+        }
+    }
+
+    bool empty() const noexcept { return segments_.empty(); }
+
+    size_t num_segments() const noexcept { return segments_.size(); }
+
+    const Token& back() const noexcept {
+        assert(!empty());
+        return segments_.back().back();
+    }
+
+    const_iterator begin() const noexcept {
+        if (empty()) {
+            return {};
+        }
+        return { segments_.data(), &segments_.back(), segments_.front().data() };
+    }
+
+    const_iterator end() const noexcept {
+        if (empty()) {
+            return {};
+        }
+        const auto& last = segments_.back();
+        return { &last, &last, last.data() + last.size() };
+    }
+};
+
+static_assert(std::bidirectional_iterator<TokenStream::const_iterator>);
@@ -0,0 +1,88 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+
+// Bump allocator for the nodes of the AST.
+//
+// The Expr and Stmt nodes are still owned through the std::unique_ptr,
+// but their memory comes from the arena that is current when they are created,
+// see the operator new of the Expr and Stmt. Deleting a node runs
+// it's destructor, the memory itself is only released together with the arena.
+// The nodes keep their addresses, and the nodes of the same pass
+// lay next to each other in memory.
+//
+// The Parser owns the arena for the statements it parses,
+// and must outlive them.
+class ASTArena {
+private:
+    static constexpr size_t block_size{ 64 * 1024 };
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* top_{ nullptr };
+    std::byte* end_{ nullptr };
+
+    static inline thread_local ASTArena* current_{ nullptr };
+
+public:
+    ASTArena() = default;
+    ASTArena(const ASTArena&) = delete;
+    ASTArena& operator=(const ASTArena&) = delete;
+
+
+    void* allocate(size_t size, size_t alignment) {
+        assert(alignment <= alignof(std::max_align_t));
+        std::byte* aligned{ align_up(top_, alignment) };
+        if (aligned > end_ || size > size_t(end_ - aligned)) {
+            add_block(size + alignment);
+            aligned = align_up(top_, alignment);
+        }
+        top_ = aligned + size;
+        return aligned;
+    }
+
+    size_t num_blocks() const noexcept { return blocks_.size(); }
+
+
+    // Makes the 'arena' current for the lifetime of the Scope.
+    class Scope {
+    private:
+        ASTArena* previous_;
+
+    public:
+        explicit Scope(ASTArena& arena) noexcept :
+            previous_{ std::exchange(current_, &arena) }
+        {}
+
+        ~Scope() { current_ = previous_; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // The nodes created outside of any Scope, in the tests, for example,
+    // are allocated from a global arena that is released on exit.
+    static ASTArena& current() noexcept {
+        static ASTArena global;
+        return current_ ? *current_ : global;
+    }
+
+private:
+    void add_block(size_t min_size) {
+        size_t size{ std::max(block_size, min_size) };
+        // Not zeroed.
+        blocks_.emplace_back(new std::byte[size]);
+        top_ = blocks_.back().get();
+        end_ = top_ + size;
+    }
+
+    static std::byte* align_up(std::byte* ptr, size_t alignment) noexcept {
+        auto address = reinterpret_cast<uintptr_t>(ptr);
+        return ptr + ((alignment - address % alignment) % alignment);
+    }
+};
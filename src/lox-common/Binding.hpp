@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+
+// The result of the static resolution of a variable reference.
+// Stored inline in the VariableExpr and AssignExpr nodes and
+// filled in by the Resolver, so that the backend could find
+// the variable without any lookup by name or by node.
+struct Binding {
+    enum class Kind : uint8_t {
+        // Not resolved (yet), or failed to resolve.
+        unresolved,
+        // Lives in an enclosing scope 'depth' scopes up from the reference.
+        local,
+        // Lives in the global scope. Depth is meaningless.
+        global
+    };
+
+    uint32_t depth{ 0 };
+    uint32_t slot{ 0 };
+    Kind kind{ Kind::unresolved };
+
+    bool is_resolved() const noexcept { return kind != Kind::unresolved; }
+};
@@ -27,7 +27,7 @@ public:
     }
 
     std::string operator()(const VariableExpr& expr) const {
-        return expr.identifier.lexeme();
+        return std::string(expr.identifier.lexeme());
     }
 
     std::string operator()(const AssignExpr& expr) const {
@@ -95,9 +95,10 @@ public:
             auto it{ ts.begin() };
 
             for (; it < ts.end() - 1; ++it) {
-                result += it->lexeme() + ", ";
+                result += it->lexeme();
+                result += ", ";
             }
-            result += (++it)->lexeme();
+            result += it->lexeme();
 
             return result;
         };
@@ -2,7 +2,9 @@
 #include <utility>
 #include <memory>
 #include <vector>
+#include "ASTArena.hpp"
 #include "Token.hpp"
+#include "Binding.hpp"
 #include "VariantWrapper.hpp"
 
 class Expr;
@@ -53,6 +55,7 @@ public:
 struct VariableExpr : ExprBackref {
 public:
     Token identifier;
+    mutable Binding binding{}; // Set by the Resolver
 
     VariableExpr(Token identifier) :
         identifier{ std::move(identifier) } {}
@@ -64,6 +67,7 @@ public:
     Token identifier;
     Token op;
     std::unique_ptr<Expr> rvalue;
+    mutable Binding binding{}; // Set by the Resolver
 
     AssignExpr(Token identifier, Token op, std::unique_ptr<Expr> rvalue) :
         identifier{ std::move(identifier) }, op{ op }, rvalue{ std::move(rvalue) } {}
@@ -108,5 +112,11 @@ class Expr : public VariantWrapper<Expr, ExprVariant> {
 public:
     using VariantWrapper<Expr, ExprVariant>::VariantWrapper;
     Expr() = delete;
+
+    // From the current ASTArena. The memory is released with the arena.
+    static void* operator new(size_t size) {
+        return ASTArena::current().allocate(size, alignof(Expr));
+    }
+    static void operator delete(void* /* ptr */) noexcept {}
 };
 
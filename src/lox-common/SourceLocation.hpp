@@ -1,37 +1,81 @@
 #pragma once
-#include <memory>
+#include <boost/unordered_map.hpp>
+#include <deque>
 #include <filesystem>
+#include <limits>
+#include <string>
+#include <cassert>
 #include <cstdint>
 #include <utility>
 
 
-// 16 + 4 bytes with 8-byte alignment = 24 bytes.
-// I wanted to pack this into 20 bytes as part of Token
-// but it seems that life is not so forgiving.
+// The paths of all the source files, indexed by a 16-bit id.
+//
+// Shared by the whole process, so that the SourceLocation
+// is just the id, and not a pointer to a path that has to be
+// copied and refcounted along with every Token.
+// Id 0 means 'no file', the prompt, for example.
+class FileTable {
+public:
+    using Id = uint16_t;
+
+    static constexpr Id no_file{ 0 };
+
+private:
+    // Deque, so that the references to the paths stay valid.
+    std::deque<std::filesystem::path> paths_;
+    boost::unordered_map<std::string, Id> ids_;
+
+    FileTable() { paths_.emplace_back(); }
+
+public:
+    FileTable(const FileTable&) = delete;
+    FileTable& operator=(const FileTable&) = delete;
+
+    static FileTable& instance() {
+        static FileTable table;
+        return table;
+    }
+
+    // The same path always gets the same id.
+    Id add(const std::filesystem::path& path) {
+        auto [it, inserted] = ids_.try_emplace(path.string(), Id(paths_.size()));
+        if (inserted) {
+            assert(paths_.size() <= std::numeric_limits<Id>::max() && "Too many source files.");
+            paths_.emplace_back(path);
+        }
+        return it->second;
+    }
+
+    const std::filesystem::path& path(Id id) const noexcept {
+        assert(id < paths_.size());
+        return paths_[id];
+    }
+};
+
+
+
+// 6 bytes, 2-byte aligned.
 struct SourceLocation {
     // UD constructors in order to disable aggregate initialization.
-    SourceLocation(uint16_t line, uint16_t column, std::shared_ptr<std::filesystem::path> file) :
-        line{ line }, column{ column }, filepath{ std::move(file) }
+    SourceLocation(uint16_t line, uint16_t column, FileTable::Id file) :
+        file_id{ file }, line{ line }, column{ column }
     {}
 
     SourceLocation(uint16_t line, uint16_t column) :
-        SourceLocation{ line, column, nullptr }
+        SourceLocation{ line, column, FileTable::no_file }
     {}
 
-    // Filenames can be long, and will not fit into the 16 or 23 byte sso buffer.
-    // We share the filenames in order to not spam the heap with strings.
-    std::shared_ptr<std::filesystem::path> filepath{ nullptr };
+    FileTable::Id file_id{ FileTable::no_file };
     // Hope that your files aren't more than ~64k lines long...
     uint16_t line;
     uint16_t column;
 
-    bool has_file() const noexcept { return filepath.get(); }
+    bool has_file() const noexcept { return file_id != FileTable::no_file; }
 
     const std::filesystem::path& file() const noexcept {
-        return *filepath;
+        return FileTable::instance().path(file_id);
     }
 
     bool operator==(const SourceLocation&) const noexcept = default;
 };
-
-
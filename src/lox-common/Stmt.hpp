@@ -1,8 +1,11 @@
 #pragma once
+#include "ASTArena.hpp"
 #include "Expr.hpp"
+#include "Binding.hpp"
 #include "Token.hpp"
 #include "VariantWrapper.hpp"
 #include <memory>
+#include <cstdint>
 #include <utility>
 #include <vector>
 
@@ -37,6 +40,7 @@ struct VarStmt : StmtBackref {
 public:
     Token identifier;
     std::unique_ptr<Expr> init;
+    mutable uint32_t slot{}; // Set by the Resolver
 
     VarStmt(Token identifier, std::unique_ptr<Expr> init) :
         identifier{ std::move(identifier) },
@@ -47,6 +51,7 @@ public:
 struct BlockStmt : StmtBackref {
 public:
     std::vector<std::unique_ptr<Stmt>> statements;
+    mutable uint32_t num_slots{}; // Set by the Resolver
 
     BlockStmt(std::vector<std::unique_ptr<Stmt>> statements) :
         statements{ std::move(statements) } {}
@@ -84,6 +89,11 @@ public:
     Token name;
     std::vector<Token> parameters;
     std::vector<std::unique_ptr<Stmt>> body;
+    mutable uint32_t slot{};        // Set by the Resolver
+    mutable uint32_t num_slots{};   // Size of the Environment of the body
+    // Variables copied into the closure at declaration,
+    // located from the scope of the declaration. Set by the Resolver.
+    mutable std::vector<Binding> captures{};
 
     FunStmt(Token name, std::vector<Token> parameters, std::vector<std::unique_ptr<Stmt>> body) :
         name{ std::move(name) }, parameters{ std::move(parameters) }, body{ std::move(body) } {}
@@ -123,5 +133,11 @@ class Stmt : public VariantWrapper<Stmt, StmtVariant> {
 public:
     using VariantWrapper<Stmt, StmtVariant>::VariantWrapper;
     Stmt() = delete;
+
+    // From the current ASTArena. The memory is released with the arena.
+    static void* operator new(size_t size) {
+        return ASTArena::current().allocate(size, alignof(Stmt));
+    }
+    static void operator delete(void* /* ptr */) noexcept {}
 };
 
@@ -2,7 +2,12 @@
 #include "TokenType.hpp"
 #include "SourceLocation.hpp"
 #include "LiteralValue.hpp"
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <fmt/format.h>
+#include <bit>
+#include <deque>
+#include <limits>
 #include <optional>
 #include <string>
 #include <sstream>
@@ -10,50 +15,191 @@
 #include <utility>
 #include <cassert>
 #include <cstdint>
+#include <variant>
 
 
 
+// The lexemes of the Tokens that don't come from a source buffer, interned.
+//
+// The Scanner makes Tokens that view the text retained by the SourceManager,
+// see Token::from_source(). The rest, made by the Parser or the tests,
+// have nowhere to point to, so their lexemes are copied here.
+// Shared by the whole process, the identical lexemes are stored once,
+// the strings are never released.
+class LexemeTable {
+private:
+    // Deque, so that the views of the strings stay valid.
+    std::deque<std::string> lexemes_;
+    // Views into the lexemes_.
+    boost::unordered_set<std::string_view> views_;
+
+    LexemeTable() = default;
+
+public:
+    LexemeTable(const LexemeTable&) = delete;
+    LexemeTable& operator=(const LexemeTable&) = delete;
+
+    static LexemeTable& instance() {
+        static LexemeTable table;
+        return table;
+    }
+
+    // The view is valid for the lifetime of the process.
+    std::string_view intern(std::string_view lexeme) {
+        if (auto it = views_.find(lexeme); it != views_.end()) {
+            return *it;
+        }
+        std::string_view stored{ lexemes_.emplace_back(lexeme) };
+        views_.emplace(stored);
+        return stored;
+    }
+};
+
+
+
+// The literal values of the Tokens, the side table.
+//
+// Most of the Tokens have no literal, and the rest
+// mostly repeat the same few, so the Token only stores
+// the id of the value here. Same sharing as in the LexemeTable.
+class LiteralTable {
+public:
+    static constexpr uint32_t none{ std::numeric_limits<uint32_t>::max() };
+
+    static constexpr uint32_t nil_id{ 0 };
+    static constexpr uint32_t false_id{ 1 };
+    static constexpr uint32_t true_id{ 2 };
+
+private:
+    // Deque, so that the references to the values stay valid.
+    std::deque<LiteralValue> literals_;
+    // By the bits of the Number.
+    boost::unordered_map<uint64_t, uint32_t> number_ids_;
+    // Views into the literals_.
+    boost::unordered_map<std::string_view, uint32_t> string_ids_;
+
+    LiteralTable() {
+        literals_.emplace_back(Nil{});
+        literals_.emplace_back(false);
+        literals_.emplace_back(true);
+    }
+
+public:
+    LiteralTable(const LiteralTable&) = delete;
+    LiteralTable& operator=(const LiteralTable&) = delete;
+
+    static LiteralTable& instance() {
+        static LiteralTable table;
+        return table;
+    }
+
+    uint32_t add(LiteralValue literal) {
+        if (std::holds_alternative<Nil>(literal)) {
+            return nil_id;
+        }
+        if (std::holds_alternative<Boolean>(literal)) {
+            return std::get<Boolean>(literal) ? true_id : false_id;
+        }
+
+        if (std::holds_alternative<Number>(literal)) {
+            auto id = static_cast<uint32_t>(literals_.size());
+            auto [it, inserted] = number_ids_.try_emplace(
+                std::bit_cast<uint64_t>(std::get<Number>(literal)), id
+            );
+            if (inserted) {
+                literals_.emplace_back(std::move(literal));
+            }
+            return it->second;
+        }
+
+        const String& string{ std::get<String>(literal) };
+        return add_string(std::string_view{ string.data(), string.size() });
+    }
+
+    // Looks the string up before making the String out of it,
+    // the repeated literals of the source are not allocated at all.
+    uint32_t add_string(std::string_view string) {
+        if (auto it = string_ids_.find(string); it != string_ids_.end()) {
+            return it->second;
+        }
+        auto id = static_cast<uint32_t>(literals_.size());
+        const String& stored{
+            std::get<String>(literals_.emplace_back(String(string.data(), string.size())))
+        };
+        string_ids_.emplace(std::string_view{ stored.data(), stored.size() }, id);
+        return id;
+    }
+
+    const LiteralValue& literal(uint32_t id) const noexcept {
+        assert(id < literals_.size());
+        return literals_[id];
+    }
+};
+
+
+
+// 24 bytes. The lexeme is a view into the source text, or into the
+// LexemeTable, the literal is kept in the LiteralTable, the file
+// of the location in the FileTable. Copying a Token is a plain copy,
+// with no allocations or refcounts involved.
 class Token {
 private:
-    std::string lexeme_;        // 32 bytes libstdc++, may change later to boost::container::string (24 bytes)
-                                // This might allow the Token to squeeze into 64 bytes total.
-                                // Lexemes are usually small and will fit into the short-string buffer.
-                                //
-                                //
-    SourceLocation location_;   // 24 bytes, can be inlined here to save 8 bytes
-    bool has_literal_;          // 1 byte (bool, is it guaranteed?)
-    TokenType type_;            // 1 byte (uint8_t) + 6 padding :(
-                                //
-    LiteralValue literal_;      // 32 bytes, stores Nil (aka monostate) when there's no literal
+    const char* lexeme_;        // Not null-terminated
+    uint32_t length_;           // Of the lexeme_
+    uint32_t literal_;          // Id in the LiteralTable, or LiteralTable::none
+    SourceLocation location_;   // 6 bytes
+    TokenType type_;            // 1 byte + 1 padding
+
+    struct from_source_tag {};
+
+    Token(from_source_tag, TokenType type, std::string_view lexeme, SourceLocation location, uint32_t literal) :
+        lexeme_{ lexeme.data() },
+        length_{ static_cast<uint32_t>(lexeme.size()) },
+        literal_{ literal },
+        location_{ location }, type_{ type }
+    {}
 
 public:
-    Token(TokenType type, std::string lexeme, SourceLocation location) :
-        type_{ type }, lexeme_{ std::move(lexeme) },
-        location_{ std::move(location) }, has_literal_{ false },
-        literal_{}
+    // The lexeme is copied into the LexemeTable.
+    Token(TokenType type, std::string_view lexeme, SourceLocation location) :
+        Token{ from_source_tag{}, type, LexemeTable::instance().intern(lexeme), location, LiteralTable::none }
     {}
 
-    Token(TokenType type, std::string lexeme, SourceLocation location, LiteralValue literal) :
-        type_{ type }, lexeme_{ std::move(lexeme) },
-        location_{ std::move(location) }, has_literal_{ true },
-        literal_{ std::move(literal) }
+    Token(TokenType type, std::string_view lexeme, SourceLocation location, LiteralValue literal) :
+        Token{
+            from_source_tag{}, type, LexemeTable::instance().intern(lexeme), location,
+            LiteralTable::instance().add(std::move(literal))
+        }
     {}
 
+    // The lexeme is not copied, it must be a slice of the source text
+    // that outlives the Token, see SourceManager. Used by the Scanner.
+    static Token from_source(TokenType type, std::string_view lexeme,
+        SourceLocation location, uint32_t literal_id = LiteralTable::none) noexcept
+    {
+        return Token{ from_source_tag{}, type, lexeme, location, literal_id };
+    }
+
 
 
     TokenType type() const noexcept { return type_; }
 
-    const std::string& lexeme() const noexcept { return lexeme_; }
+    std::string_view lexeme() const noexcept {
+        return { lexeme_, length_ };
+    }
 
-    bool has_literal() const noexcept { return has_literal_; }
-    const LiteralValue& literal() const noexcept { return literal_; }
+    bool has_literal() const noexcept { return literal_ != LiteralTable::none; }
+    // Nil when there's no literal.
+    const LiteralValue& literal() const noexcept {
+        return LiteralTable::instance().literal(has_literal() ? literal_ : LiteralTable::nil_id);
+    }
 
     uint16_t line() const noexcept { return location_.line; }
 
     uint16_t column() const noexcept { return location_.column; }
 
     bool has_file() const noexcept { return location_.has_file(); }
-    const std::filesystem::path& file() const noexcept { return *location_.filepath; }
+    const std::filesystem::path& file() const noexcept { return location_.file(); }
 
     const SourceLocation& location() const noexcept { return location_; }
 
@@ -88,3 +234,5 @@ public:
     operator TokenType() const { return type(); }
 
 };
+
+static_assert(sizeof(Token) == 24);
@@ -1,10 +1,12 @@
 #pragma once
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <array>
+#include <utility>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include "Utils.hpp"
 
 enum class TokenType : uint8_t {
@@ -83,29 +85,95 @@ inline constexpr std::array token_type_lexemes{
 };
 
 
-inline const std::unordered_map<std::string, TokenType> keyword_map{
-    {"and",     TokenType::kw_and},
-    {"class",   TokenType::kw_class},
-    {"else",    TokenType::kw_else},
-    {"false",   TokenType::kw_false},
-    {"fun",     TokenType::kw_fun},
-    {"for",     TokenType::kw_for},
-    {"if",      TokenType::kw_if},
-    {"nil",     TokenType::kw_nil},
-    {"or",      TokenType::kw_or},
-    {"print",   TokenType::kw_print},
-    {"return",  TokenType::kw_return},
-    {"super",   TokenType::kw_super},
-    {"this",    TokenType::kw_this},
-    {"true",    TokenType::kw_true},
-    {"var",     TokenType::kw_var},
-    {"while",   TokenType::kw_while},
-    {"import",   TokenType::kw_import},
+// The keywords are looked up in a table, by a hash of the length,
+// the first and the last characters of the lexeme. The multiplier
+// of the hash is found at compile time, such that no two keywords
+// share a slot. The lexeme in the slot is compared only once.
+struct KeywordSlot {
+    std::string_view lexeme;
+    TokenType type{ TokenType::identifier };
+};
+
+inline constexpr auto first_keyword{ to_underlying(TokenType::kw_and) };
+inline constexpr auto last_keyword{ to_underlying(TokenType::kw_import) };
+
+inline constexpr auto keywords{
+    [] {
+        std::array<KeywordSlot, last_keyword - first_keyword + 1> result{};
+        for (auto type{ first_keyword }; type <= last_keyword; ++type) {
+            result[type - first_keyword] = { token_type_lexemes[type], TokenType(type) };
+        }
+        return result;
+    }()
+};
+
+// About 4 slots per keyword, so that the multiplier is found quickly.
+inline constexpr size_t keyword_table_bits{ 6 };
+
+constexpr size_t keyword_slot(std::string_view lexeme, uint32_t multiplier) noexcept {
+    uint32_t key{
+        static_cast<uint32_t>(lexeme.size()) << 16 |
+        static_cast<uint32_t>(static_cast<uint8_t>(lexeme.front())) << 8 |
+        static_cast<uint32_t>(static_cast<uint8_t>(lexeme.back()))
+    };
+    return (key * multiplier) >> (32 - keyword_table_bits);
+}
+
+// Odd multipliers, starting from the golden ratio.
+constexpr uint32_t find_keyword_multiplier() {
+    for (uint32_t multiplier{ 0x9E3779B1 }; multiplier != 1; multiplier += 2) {
+        std::array<bool, size_t{ 1 } << keyword_table_bits> is_taken{};
+        bool is_perfect{ true };
+        for (const auto& keyword : keywords) {
+            size_t slot{ keyword_slot(keyword.lexeme, multiplier) };
+            is_perfect = is_perfect && !is_taken[slot];
+            is_taken[slot] = true;
+        }
+        if (is_perfect) {
+            return multiplier;
+        }
+    }
+    return 0;
+}
+
+inline constexpr uint32_t keyword_multiplier{ find_keyword_multiplier() };
+static_assert(keyword_multiplier != 0, "No perfect hash for the keywords.");
+
+inline constexpr auto keyword_table{
+    [] {
+        std::array<KeywordSlot, size_t{ 1 } << keyword_table_bits> table{};
+        for (const auto& keyword : keywords) {
+            table[keyword_slot(keyword.lexeme, keyword_multiplier)] = keyword;
+        }
+        return table;
+    }()
+};
+
+// Anything shorter or longer is not even hashed.
+inline constexpr auto keyword_sizes{
+    [] {
+        std::pair<size_t, size_t> sizes{ SIZE_MAX, 0 };
+        for (const auto& keyword : keywords) {
+            sizes.first = std::min(sizes.first, keyword.lexeme.size());
+            sizes.second = std::max(sizes.second, keyword.lexeme.size());
+        }
+        return sizes;
+    }()
 };
 
 } // namespace detail
 
 
+// One of the keywords, or an identifier.
+constexpr TokenType keyword_or_identifier(std::string_view lexeme) noexcept {
+    if (lexeme.size() < detail::keyword_sizes.first || lexeme.size() > detail::keyword_sizes.second) {
+        return TokenType::identifier;
+    }
+    const auto& slot = detail::keyword_table[detail::keyword_slot(lexeme, detail::keyword_multiplier)];
+    return slot.lexeme == lexeme ? slot.type : TokenType::identifier;
+}
+
+
 inline std::string to_string(TokenType type) {
     return { detail::token_type_names[
         to_underlying(type)
@@ -12,7 +12,7 @@
 
 
 template<typename EnumType>
-std::underlying_type_t<EnumType> to_underlying(EnumType value) {
+constexpr std::underlying_type_t<EnumType> to_underlying(EnumType value) noexcept {
     return static_cast<std::underlying_type_t<EnumType>>(value);
 }
 
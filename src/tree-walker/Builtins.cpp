@@ -50,11 +50,11 @@ void setup_builtins(Environment& env, Resolver& resolver) {
         // name is passed by const char* due to BuiltinFunction storing a const char*.
         std::string name_string{ name };
 
-        bool success = resolver.declare(name_string);
-        assert(success && "This should definetly not happen.");
+        auto slot = resolver.declare(name_string);
+        assert(slot && "This should definetly not happen.");
         resolver.define(name_string);
 
-        env.define(name_string, BuiltinFunction{ name, fun, arity });
+        env.define(*slot, BuiltinFunction{ name, fun, arity });
 
         // Also, just wondering, why the std::string(std::string_view) constructor is explicit?
         // Like, annoying.
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include "Value.hpp"
+
+
+// The result of executing a statement.
+//
+// A 'ret' completion is produced by the ReturnStmt and is propagated
+// by the enclosing statements up to the Function::operator(),
+// which unwraps the returned value. This replaces walking up
+// the call stack with exceptions, which was slow.
+struct Completion {
+    enum class Type : uint8_t {
+        normal,
+        ret
+    };
+
+    Type type{ Type::normal };
+    Value value{};
+
+    Completion() = default;
+
+    explicit Completion(Value return_value) :
+        type{ Type::ret }, value{ std::move(return_value) } {}
+
+    bool is_return() const noexcept { return type == Type::ret; }
+};
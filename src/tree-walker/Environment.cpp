@@ -2,64 +2,53 @@
 #include "Value.hpp"
 #include <utility>
 
-template class boost::unordered_map<std::string, Value>;
 
+Environment::Environment(Environment* enclosing, size_t num_slots) :
+        slots_( num_slots ), enclosing_{ enclosing } {}
 
-Environment::Environment(Environment* enclosing, boost::unordered_map<std::string, Value> map) :
-        enclosing_{ enclosing }, map_{ std::move(map) } {}
 
+// Parens for slots_, braces would select the initializer_list constructor.
+Environment::Environment(Environment* enclosing, std::vector<Value> slots) :
+        slots_( std::move(slots) ), enclosing_{ enclosing } {}
 
-// Returns a handle to a Value in a local map.
+
+// Returns a handle to a Value in a local storage.
 // Does not recurse to the enclosing environments.
 //
-// If the value at map_[name] is a ValueHandle, decays it
+// If the value at slots_[slot] is a ValueHandle, decays it
 // so as to not form the handle to a handle.
 // Otherwise, just returns a handle to the Value.
-ValueHandle Environment::make_handle(decltype(map_)::mapped_type& target) {
+ValueHandle Environment::make_handle(Value& target) {
     return ValueHandle{ decay(target) };
 }
 
 
 // Retruns a handle to the new element
-ValueHandle Environment::define(const std::string& name, Value value) {
-    auto [it, was_inserted] = map_.insert_or_assign(name, std::move(value));
-    return make_handle(it->second);
+ValueHandle Environment::define(size_t slot, Value value) {
+    resize(slot + 1);
+    slots_[slot] = std::move(value);
+    return make_handle(slots_[slot]);
 }
 
 
-ValueHandle Environment::get(const std::string& name) {
-    if (map_.contains(name)) {
-        return make_handle(map_[name]);
-    } else if (enclosing_) {
-        return enclosing_->get(name);
-    } else {
-        return {};
-    }
-}
-
-ValueHandle Environment::assign(const std::string& name, Value value) {
-    if (map_.contains(name)) {
-        map_[name] = std::move(value);
-        return make_handle(map_[name]);
-    } else if (enclosing_) {
-        return enclosing_->assign(name, std::move(value));
-    } else {
-        return {};
+void Environment::resize(size_t num_slots) {
+    if (num_slots > slots_.size()) {
+        slots_.resize(num_slots);
     }
 }
 
 
-ValueHandle Environment::get_at(size_t distance, const std::string& name) {
+ValueHandle Environment::get_at(size_t distance, size_t slot) {
     assert(ancestor(distance));
-    assert(ancestor(distance)->map_.contains(name));
-    return make_handle(ancestor(distance)->map_[name]);
+    assert(slot < ancestor(distance)->slots_.size());
+    return make_handle(ancestor(distance)->slots_[slot]);
 }
 
 
-ValueHandle Environment::assign_at(size_t distance, const std::string& name, Value value) {
+ValueHandle Environment::assign_at(size_t distance, size_t slot, Value value) {
     assert(ancestor(distance));
-    assert(ancestor(distance)->map_.contains(name));
-    Value& value_ref = ancestor(distance)->map_[name];
+    assert(slot < ancestor(distance)->slots_.size());
+    Value& value_ref = ancestor(distance)->slots_[slot];
     value_ref = std::move(value);
     return make_handle(value_ref);
 }
@@ -1,14 +1,18 @@
 #pragma once
-#include <string>
+#include <vector>
 #include <utility>
-#include <boost/unordered_map.hpp>
 #include "ValueDecl.hpp"
 
 
 
+// Storage for the variables of a single scope.
+//
+// Variables are not looked up by name, instead the Resolver assigns
+// each declaration a slot in it's scope, and each reference
+// a (depth, slot) pair, see Binding.hpp.
 class Environment {
 private:
-    boost::unordered_map<std::string, Value> map_;
+    std::vector<Value> slots_;
     Environment* enclosing_{ nullptr };
 
 public:
@@ -17,24 +21,27 @@ public:
     explicit Environment(Environment* enclosing) :
         enclosing_{ enclosing } {}
 
-    Environment(Environment* enclosing, boost::unordered_map<std::string, Value> map);
+    // Preallocates all the slots of the scope, so that
+    // the defines inside never have to reallocate.
+    Environment(Environment* enclosing, size_t num_slots);
 
-    ValueHandle define(const std::string& name, Value value);
+    Environment(Environment* enclosing, std::vector<Value> slots);
 
-    ValueHandle get(const std::string& name);
+    ValueHandle define(size_t slot, Value value);
 
-    ValueHandle get_at(size_t distance, const std::string& name);
+    ValueHandle get_at(size_t distance, size_t slot);
 
-    ValueHandle assign(const std::string& name, Value value);
+    ValueHandle assign_at(size_t distance, size_t slot, Value value);
 
-    ValueHandle assign_at(size_t distance, const std::string& name, Value value);
+    // Only grows the storage. New slots are initialized to Nil.
+    void resize(size_t num_slots);
 
     Environment* enclosing() const noexcept { return enclosing_; }
 
-    const auto& map() const noexcept { return map_; }
+    const auto& slots() const noexcept { return slots_; }
 
 private:
-    static ValueHandle make_handle(decltype(map_)::mapped_type& name);
+    static ValueHandle make_handle(Value& target);
 
     Environment* ancestor(size_t distance) {
         Environment* current{ this };
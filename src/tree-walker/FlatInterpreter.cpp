@@ -0,0 +1,417 @@
+#include "FlatInterpreter.hpp"
+
+#include <fmt/format.h>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+
+
+// Specialization of Function call with the FlatInterpreter
+
+template<>
+Value Function::operator()<FlatInterpreter>(FlatInterpreter& interpreter, std::span<Value> args) {
+    assert(declaration());
+    assert(flat_function() != FlatAST::none);
+    Environment env{ closure(), declaration()->num_slots };
+
+    // Slot 0 is the function itself, parameters follow.
+    // See ResolveVisitor::resolve_function().
+    env.define(0, std::as_const(*this));
+    for (size_t i{ 0 }; i < args.size(); ++i) {
+        env.define(i + 1, std::move(args[i]));
+    }
+
+    Completion completion{
+        interpreter.interpret(interpreter.ast().function(flat_function()), env)
+    };
+    return std::move(completion.value);
+}
+
+
+template<>
+Value BuiltinFunction::operator()<FlatInterpreter>(FlatInterpreter&, std::span<Value> args) {
+    return fun_(args);
+}
+
+
+
+
+bool FlatInterpreter::interpret(std::span<const std::unique_ptr<Stmt>> statements) {
+    // Make room for the globals declared during the last resolve pass,
+    // so that no global is ever read out of bounds.
+    env_.resize(resolver_.num_global_slots());
+
+    FlatAST::Range range{ ast_.append(statements) };
+
+    constants_.reserve(ast_.num_constants());
+    for (size_t i{ constants_.size() }; i < ast_.num_constants(); ++i) {
+        constants_.push_back(
+            std::visit([](auto&& arg) { return Value{ arg }; }, ast_.constant(Index(i)))
+        );
+    }
+
+    try {
+        for (Index statement : ast_.list(range)) {
+            execute(statement, env_);
+        }
+        return true;
+    } catch (InterpreterError::Type) {
+        return false;
+    }
+}
+
+
+Completion FlatInterpreter::interpret(const FlatAST::Function& function, Environment& env) {
+    try {
+        return execute(ast_.list(function.first, function.size), env);
+    } catch (InterpreterError::Type) {
+        return {};
+    }
+}
+
+
+
+
+// Interprets the expression and decays the result.
+//
+// Only the variables evaluate to a ValueHandle, see evaluate_without_decay().
+// Copying the variable right away saves moving every other result
+// through the decay(), the way the InterpretVisitor does.
+Value FlatInterpreter::evaluate(Index index, Environment& env) {
+    const FlatAST::Node& node{ ast_.node(index) };
+
+    // Each kind in it's own function keeps the frame of this one small,
+    // it's on the stack once for every level of the evaluated expression.
+    switch (node.kind) {
+        case FlatAST::Kind::literal:
+            return constants_[node.a];
+        case FlatAST::Kind::unary:
+            return unary(node, index, env);
+        case FlatAST::Kind::binary:
+            return binary(node, index, env);
+        case FlatAST::Kind::variable:
+            return variable(node, index, env).decay();
+        case FlatAST::Kind::assign:
+            return assign(node, index, env);
+        case FlatAST::Kind::logical:
+            return logical(node, env);
+        case FlatAST::Kind::call:
+            return call(node, index, env);
+        default:
+            assert(false && "Not an expression node.");
+            return {};
+    }
+}
+
+
+// Used when value could be mutated through a reference,
+// see InterpretVisitor::evaluate_without_decay().
+Value FlatInterpreter::evaluate_without_decay(Index index, Environment& env) {
+    const FlatAST::Node& node{ ast_.node(index) };
+    if (node.kind == FlatAST::Kind::variable) {
+        // Return ValueHandle directly
+        return variable(node, index, env);
+    }
+    return evaluate(index, env);
+}
+
+
+
+
+Value FlatInterpreter::unary(const FlatAST::Node& node, Index index, Environment& env) {
+    Value val{ evaluate(node.a, env) };
+
+    switch (node.op) {
+        case TokenType::minus:
+            check_type<Number>(index, val);
+            return -val.as<Number>();
+        case TokenType::plus:
+            check_type<Number>(index, val);
+            break;
+        case TokenType::bang:
+            return !is_truthful(val);
+        default:
+            break;
+    }
+    return {};
+}
+
+
+Value FlatInterpreter::binary(const FlatAST::Node& node, Index index, Environment& env) {
+    Value lhs{ evaluate(node.a, env) };
+    Value rhs{ evaluate(node.b, env) };
+
+    using enum TokenType;
+    switch (node.op) {
+        case minus:
+            check_type<Number, Number>(index, lhs, rhs);
+            return lhs.as<Number>() - rhs.as<Number>();
+        case slash:
+            check_type<Number, Number>(index, lhs, rhs);
+            return lhs.as<Number>() / rhs.as<Number>();
+        case star:
+            check_type<Number, Number>(index, lhs, rhs);
+            return lhs.as<Number>() * rhs.as<Number>();
+        case plus:
+            if (lhs.is<Number>() && rhs.is<Number>()) {
+                return lhs.as<Number>() + rhs.as<Number>();
+            } else if (lhs.is<String>() && rhs.is<String>()) {
+                return lhs.as<String>() + rhs.as<String>();
+            } else {
+                report_error_and_abort(
+                    InterpreterError::Type::unexpected_type, index,
+                    fmt::format(
+                        "Expected a pair of Numbers or Strings, Encountered {:s} and {:s}",
+                        type_name(lhs), type_name(rhs)
+                    )
+                );
+            }
+            break;
+        case greater:
+            check_type<Number, Number>(index, lhs, rhs);
+            return lhs.as<Number>() > rhs.as<Number>();
+        case greater_eq:
+            check_type<Number, Number>(index, lhs, rhs);
+            return lhs.as<Number>() >= rhs.as<Number>();
+        case less:
+            check_type<Number, Number>(index, lhs, rhs);
+            return lhs.as<Number>() < rhs.as<Number>();
+        case less_eq:
+            check_type<Number, Number>(index, lhs, rhs);
+            return lhs.as<Number>() <= rhs.as<Number>();
+        case eq_eq:
+            return lhs == rhs;
+        case bang_eq:
+            return lhs != rhs;
+        default:
+            break;
+    }
+    return {};
+}
+
+
+ValueHandle FlatInterpreter::variable(const FlatAST::Node& node, Index index, Environment& env) {
+    if (node.binding == Binding::Kind::unresolved) {
+        report_error_and_abort(
+            InterpreterError::Type::undefined_variable, index,
+            ast_.source(index).as<VariableExpr>().identifier.lexeme()
+        );
+    }
+    ValueHandle handle = get_environment(node.binding, env).get_at(node.a, node.b);
+    assert(handle);
+    return handle;
+}
+
+
+Value FlatInterpreter::assign(const FlatAST::Node& node, Index index, Environment& env) {
+    if (node.binding == Binding::Kind::unresolved) {
+        report_error_and_abort(
+            InterpreterError::Type::undefined_variable, index,
+            ast_.source(index).as<AssignExpr>().identifier.lexeme()
+        );
+    }
+    ValueHandle val = get_environment(node.binding, env).assign_at(
+        node.a, node.b, evaluate(node.c, env)
+    );
+    assert(val);
+    return *val;
+}
+
+
+Value FlatInterpreter::logical(const FlatAST::Node& node, Environment& env) {
+    Value lhs{ evaluate(node.a, env) };
+
+    if (node.op == TokenType::kw_or) {
+        if (is_truthful(lhs)) { return lhs; }
+    } else {
+        if (!is_truthful(lhs)) { return lhs; }
+    }
+
+    return evaluate(node.b, env);
+}
+
+
+Value FlatInterpreter::call(const FlatAST::Node& node, Index index, Environment& env) {
+    Value callee_maybe_handle = evaluate_without_decay(node.a, env);
+    Value& callee = decay(callee_maybe_handle);
+
+    std::vector<Value> args;
+    args.reserve(node.c);
+    for (Index arg : ast_.list(node.b, node.c)) {
+        args.emplace_back(evaluate(arg, env));
+    }
+
+    if (callee.is<Function>()) {
+        return get_invokable<Function>(callee, args, index)(*this, args);
+    } else if (callee.is<BuiltinFunction>()) {
+        return get_invokable<BuiltinFunction>(callee, args, index)(*this, args);
+    } else {
+        report_error_and_abort(
+            InterpreterError::Type::unexpected_type, index,
+            fmt::format(
+                "Expected {} or {}, Encountered {}",
+                type_name(Value(Function{ nullptr })),
+                type_name(Value(BuiltinFunction{ "", nullptr, 0 })),
+                type_name(callee)
+            )
+        );
+    }
+
+    return {};
+}
+
+
+
+
+Completion FlatInterpreter::execute(Index index, Environment& env) {
+    const FlatAST::Node& node{ ast_.node(index) };
+
+    switch (node.kind) {
+        case FlatAST::Kind::expression:
+            evaluate(node.a, env);
+            return {};
+        case FlatAST::Kind::print:
+            print(node, env);
+            return {};
+        case FlatAST::Kind::var:
+            env.define(node.a, evaluate(node.b, env));
+            return {};
+        case FlatAST::Kind::block:
+            return block(node, env);
+        case FlatAST::Kind::if_:
+            if (is_truthful(evaluate(node.a, env))) {
+                return execute(node.b, env);
+            } else if (node.c != FlatAST::none) {
+                return execute(node.c, env);
+            }
+            return {};
+        case FlatAST::Kind::while_:
+            return while_loop(node, env);
+        case FlatAST::Kind::fun:
+            fun(node, env);
+            return {};
+        case FlatAST::Kind::ret:
+            // Propagated up to the Function::operator()
+            // through the return values of the enclosing statements.
+            return Completion{ evaluate(node.a, env) };
+        case FlatAST::Kind::import:
+            return {};
+        default:
+            assert(false && "Not a statement node.");
+            return {};
+    }
+}
+
+
+void FlatInterpreter::print(const FlatAST::Node& node, Environment& env) {
+    auto value = evaluate(node.a, env);
+    std::cout << to_string(value) << '\n';
+}
+
+
+Completion FlatInterpreter::block(const FlatAST::Node& node, Environment& env) {
+    Environment block_env{ &env, node.c };
+    return execute(ast_.list(node.a, node.b), block_env);
+}
+
+
+Completion FlatInterpreter::while_loop(const FlatAST::Node& node, Environment& env) {
+    while (is_truthful(evaluate(node.a, env))) {
+        if (Completion completion{ execute(node.b, env) };
+            completion.is_return())
+        {
+            return completion;
+        }
+    }
+    return {};
+}
+
+
+// See InterpretVisitor::operator()(const FunStmt&).
+void FlatInterpreter::fun(const FlatAST::Node& node, Environment& env) {
+    const FunStmt& stmt{ *ast_.function(node.a).declaration };
+
+    std::vector<Value> captures;
+    captures.reserve(stmt.captures.size());
+    for (const Binding& capture : stmt.captures) {
+        captures.emplace_back(
+            get_environment(capture.kind, env).get_at(capture.depth, capture.slot).decay()
+        );
+    }
+
+    env.define(
+        stmt.slot,
+        Function{ &stmt, std::move(captures), node.a }
+    );
+}
+
+
+Completion FlatInterpreter::execute(std::span<const Index> statements, Environment& env) {
+    for (Index statement : statements) {
+        if (Completion completion{ execute(statement, env) };
+            completion.is_return())
+        {
+            return completion;
+        }
+    }
+    return {};
+}
+
+
+
+
+bool FlatInterpreter::is_truthful(const Value& value) {
+    if (value.is<Nil>()) {
+        return false;
+    }
+
+    if (value.is<Boolean>()) {
+        return value.as<Boolean>();
+    } else {
+        return true;
+    }
+}
+
+
+template<typename T>
+void FlatInterpreter::check_type(Index index, const Value& val) const {
+    if (!val.is<T>()) {
+        report_error_and_abort(
+            InterpreterError::Type::unexpected_type, index,
+            fmt::format("Expected {:s}, Encountered {:s}", type_name(Value{T{}}), type_name(val))
+        );
+    }
+}
+
+
+template<typename T1, typename T2>
+void FlatInterpreter::check_type(Index index, const Value& val1, const Value& val2) const {
+    check_type<T1>(index, val1);
+    check_type<T2>(index, val2);
+}
+
+
+void FlatInterpreter::report_error_and_abort(InterpreterError::Type type, Index index, std::string_view details) const {
+    send_error(type, ast_.source(index), std::string(details));
+    abort_by_exception(type);
+}
+
+
+template<typename CallableValue>
+CallableValue& FlatInterpreter::get_invokable(Value& callee, std::vector<Value>& args, Index index) const {
+    CallableValue& function = callee.as<CallableValue>();
+
+    if (function.arity() != args.size()) {
+        report_error_and_abort(
+            InterpreterError::Type::wrong_num_of_arguments, index,
+            fmt::format(
+                "Expected {}, Encountered {}",
+                function.arity(),
+                args.size()
+            )
+        );
+    }
+
+    return function;
+}
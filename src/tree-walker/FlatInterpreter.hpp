@@ -0,0 +1,90 @@
+#pragma once
+#include "InterpreterError.hpp"
+#include "ErrorSender.hpp"
+#include "Environment.hpp"
+#include "Completion.hpp"
+#include "FlatAST.hpp"
+#include "Stmt.hpp"
+#include "Value.hpp"
+#include "Resolver.hpp"
+#include <span>
+#include <memory>
+#include <vector>
+
+
+
+// Interprets the FlatAST instead of walking the Stmt and Expr nodes.
+//
+// Same semantics as the Interpreter and the InterpretVisitor,
+// but the nodes are dispatched by a switch over the FlatAST::Kind,
+// and the children are found by index, in the same contiguous storage.
+// The statements of each pass are flattened and appended to the tree,
+// the Functions declared in the previous passes stay valid.
+class FlatInterpreter : private ErrorSender<InterpreterError> {
+private:
+    using Index = FlatAST::Index;
+
+    Resolver& resolver_;
+    Environment env_;
+    FlatAST ast_;
+    // The constants of the ast_, converted to Values once.
+    std::vector<Value> constants_;
+
+public:
+    FlatInterpreter(ErrorReporter& err, Resolver& resolver) :
+        ErrorSender{ err },
+        resolver_{ resolver },
+        env_{}
+    {}
+
+    bool interpret(std::span<const std::unique_ptr<Stmt>> statements);
+
+    // Interprets the body of a function. Stops at the first
+    // 'return' statement and passes it's completion through.
+    Completion interpret(const FlatAST::Function& function, Environment& env);
+
+    Environment& get_global_environment() noexcept { return env_; }
+
+    const FlatAST& ast() const noexcept { return ast_; }
+
+private:
+    Value evaluate(Index index, Environment& env);
+    Value evaluate_without_decay(Index index, Environment& env);
+
+    Completion execute(Index index, Environment& env);
+    Completion execute(std::span<const Index> statements, Environment& env);
+
+    Value unary(const FlatAST::Node& node, Index index, Environment& env);
+    Value binary(const FlatAST::Node& node, Index index, Environment& env);
+    ValueHandle variable(const FlatAST::Node& node, Index index, Environment& env);
+    Value assign(const FlatAST::Node& node, Index index, Environment& env);
+    Value logical(const FlatAST::Node& node, Environment& env);
+    Value call(const FlatAST::Node& node, Index index, Environment& env);
+
+    void print(const FlatAST::Node& node, Environment& env);
+    Completion block(const FlatAST::Node& node, Environment& env);
+    Completion while_loop(const FlatAST::Node& node, Environment& env);
+    void fun(const FlatAST::Node& node, Environment& env);
+
+
+    static bool is_truthful(const Value& value);
+
+    template<typename T>
+    void check_type(Index index, const Value& val) const;
+
+    template<typename T1, typename T2>
+    void check_type(Index index, const Value& val1, const Value& val2) const;
+
+    void report_error_and_abort(InterpreterError::Type type, Index index, std::string_view details = "") const;
+
+    Environment& get_environment(Binding::Kind kind, Environment& env) noexcept {
+        return kind == Binding::Kind::global ? env_ : env;
+    }
+
+    template<typename CallableValue>
+    CallableValue& get_invokable(Value& callee, std::vector<Value>& args, Index index) const;
+
+    void abort_by_exception(InterpreterError::Type type) const noexcept(false) {
+        throw type;
+    }
+};
@@ -1,11 +1,13 @@
 #include "InterpretVisitor.hpp"
 
+#include "Completion.hpp"
 #include "Environment.hpp"
 #include "Interpreter.hpp"
 #include "InterpreterError.hpp"
 #include "Value.hpp"
 #include <fmt/format.h>
 #include <vector>
+#include <utility>
 
 
 
@@ -24,25 +26,19 @@
 template<>
 Value Function::operator()<Interpreter>(Interpreter& interpreter, std::span<Value> args) {
     assert(declaration());
-    // Environment from enclosing scope,
-    // captured by copy during construction of Function
-    Environment env{ &closure() };
+    // Encloses the captured variables,
+    // copied during construction of Function
+    Environment env{ closure(), declaration()->num_slots };
 
+    // Slot 0 is the function itself, parameters follow.
+    // See ResolveVisitor::resolve_function().
+    env.define(0, std::as_const(*this));
     for (size_t i{ 0 }; i < args.size(); ++i) {
-        env.define(
-            declaration()->parameters[i].lexeme(), std::move(args[i])
-        );
-    }
-
-    try {
-        interpreter.interpret(
-            declaration()->body, env
-        );
-    } catch (Value& v) {
-        return std::move(v);
+        env.define(i + 1, std::move(args[i]));
     }
 
-    return {};
+    Completion completion{ interpreter.interpret(declaration()->body, env) };
+    return std::move(completion.value);
 }
 
 
@@ -79,8 +75,8 @@ Value InterpretVisitor::evaluate_without_decay(const Expr& expr) const {
 }
 
 
-void InterpretVisitor::execute(const Stmt& stmt) const {
-    stmt.accept(*this);
+Completion InterpretVisitor::execute(const Stmt& stmt) const {
+    return stmt.accept(*this);
 }
 
 
@@ -131,6 +127,27 @@ void InterpretVisitor::report_error_and_abort(InterpreterError::Type type, const
 }
 
 
+template<typename ExprT>
+const Binding& InterpretVisitor::get_binding(const ExprT& expr) const {
+    if (!expr.binding.is_resolved()) {
+        report_error_and_abort(
+            InterpreterError::Type::undefined_variable,
+            Expr::from_alternative(expr), expr.identifier.lexeme()
+        );
+    }
+    return expr.binding;
+}
+
+
+// Globals are accessed directly, without walking the chain.
+Environment& InterpretVisitor::get_environment(const Binding& binding) const {
+    if (binding.kind == Binding::Kind::global) {
+        return interpreter_.env_;
+    }
+    return env_;
+}
+
+
 template<typename CallableValue>
 CallableValue& InterpretVisitor::get_invokable(Value& callee, std::vector<Value>& args, const CallExpr& expr) const {
     CallableValue& function = callee.as<CallableValue>();
@@ -270,24 +287,8 @@ Value InterpretVisitor::operator()(const GroupedExpr& expr) const {
 
 
 Value InterpretVisitor::operator()(const VariableExpr& expr) const {
-
-    // FIXME now that the global scope is proper scope
-    auto& depths = interpreter_.resolver_.depth_map();
-    auto it = depths.find(&Expr::from_alternative(expr));
-
-    ValueHandle handle{};
-
-    if (it != depths.end()) {
-        handle = env_.get_at(it->second, expr.identifier.lexeme());
-    } else {
-        handle = interpreter_.env_.get(expr.identifier.lexeme());
-        if (!handle) {
-            report_error_and_abort(
-                InterpreterError::Type::undefined_variable,
-                expr, expr.identifier.lexeme()
-            );
-        }
-    }
+    const Binding& binding{ get_binding(expr) };
+    ValueHandle handle = get_environment(binding).get_at(binding.depth, binding.slot);
     assert(handle);
     // Return ValueHandle directly
     return handle;
@@ -297,30 +298,13 @@ Value InterpretVisitor::operator()(const VariableExpr& expr) const {
 
 
 Value InterpretVisitor::operator()(const AssignExpr& expr) const {
-    auto& depths = interpreter_.resolver_.depth_map();
-
-    auto it = depths.find(&Expr::from_alternative(expr));
-    if (it != depths.end()) {
-        ValueHandle val = env_.assign_at(
-            it->second,
-            expr.identifier.lexeme(),
-            evaluate(*expr.rvalue)
-        );
-        assert(val); // This whole thing is so fragile, I hate it
-        return *val;
-    } else {
-        ValueHandle val = interpreter_.env_.assign(
-            expr.identifier.lexeme(),
-            evaluate(*expr.rvalue)
-        );
-
-        if (!val) {
-            report_error_and_abort(
-                InterpreterError::Type::undefined_variable, expr, expr.identifier.lexeme()
-            );
-        }
-        return *val;
-    }
+    const Binding& binding{ get_binding(expr) };
+    ValueHandle val = get_environment(binding).assign_at(
+        binding.depth, binding.slot,
+        evaluate(*expr.rvalue)
+    );
+    assert(val);
+    return *val;
 }
 
 
@@ -386,118 +370,109 @@ Value InterpretVisitor::operator()(const CallExpr& expr) const {
 
 
 
-void InterpretVisitor::operator()(const PrintStmt& stmt) const {
+Completion InterpretVisitor::operator()(const PrintStmt& stmt) const {
     auto value = evaluate(*stmt.expr);
     std::cout << to_string(value) << '\n';
+    return {};
 }
 
 
 
 
-void InterpretVisitor::operator()(const ExpressionStmt& stmt) const {
+Completion InterpretVisitor::operator()(const ExpressionStmt& stmt) const {
     evaluate(*stmt.expr);
+    return {};
 }
 
 
 
 
-void InterpretVisitor::operator()(const VarStmt& stmt) const {
-    env_.define(stmt.identifier.lexeme(), evaluate(*stmt.init));
+Completion InterpretVisitor::operator()(const VarStmt& stmt) const {
+    env_.define(stmt.slot, evaluate(*stmt.init));
+    return {};
 }
 
 
 
 
-void InterpretVisitor::operator()(const BlockStmt& stmt) const {
-    Environment block_env{ &env_ };
+Completion InterpretVisitor::operator()(const BlockStmt& stmt) const {
+    Environment block_env{ &env_, stmt.num_slots };
     InterpretVisitor block_visitor{ interpreter_, block_env };
 
     for (const auto& statement : stmt.statements) {
-        block_visitor.execute(*statement);
+        if (Completion completion{ block_visitor.execute(*statement) };
+            completion.is_return())
+        {
+            return completion;
+        }
     }
+    return {};
 }
 
 
 
 
-void InterpretVisitor::operator()(const IfStmt& stmt) const {
+Completion InterpretVisitor::operator()(const IfStmt& stmt) const {
     if (is_truthful(evaluate(*stmt.condition))) {
-        execute(*stmt.then_branch);
+        return execute(*stmt.then_branch);
     } else if (stmt.else_branch) {
-        execute(*stmt.else_branch);
+        return execute(*stmt.else_branch);
     }
+    return {};
 }
 
 
 
 
-void InterpretVisitor::operator()(const WhileStmt& stmt) const {
+Completion InterpretVisitor::operator()(const WhileStmt& stmt) const {
     while (is_truthful(evaluate(*stmt.condition))) {
-        execute(*stmt.statement);
-    }
-}
-
-
-
-
-static void flatten_into_closure(Environment& closure, const Environment* starting) {
-    const Environment* enclosing{ starting };
-    while (enclosing) {
-        for (const auto& elem : enclosing->map()) {
-            if (!closure.get(elem.first)) {
-                closure.define(elem.first, elem.second);
-            }
+        if (Completion completion{ execute(*stmt.statement) };
+            completion.is_return())
+        {
+            return completion;
         }
-        enclosing = enclosing->enclosing();
     }
+    return {};
 }
 
 
-void InterpretVisitor::operator()(const FunStmt& stmt) const {
-    // Hail Mary closure that copies EVERYTHING from outer scopes,
-    // essentially, storing the state of the entire program at capture time.
-    // Absolutely horrible, but should work.
 
-    // First, intialize without any enclosing scopes.
-    Environment closure{ nullptr };
 
-    // Ther recursively copy values for symbols not yet in closure,
-    // starting from the current scope.
-    flatten_into_closure(closure, &env_);
-
-    // Add this function to the current environment.
-    ValueHandle fun_handle = env_.define(
-        stmt.name.lexeme(),
-        Function{
-            &stmt,
-            std::move(closure)
-        }
-    );
+Completion InterpretVisitor::operator()(const FunStmt& stmt) const {
+    // Copy only the variables that the body references,
+    // see ResolveVisitor::resolve_local().
+    //
+    // The closure is captured before the function is defined,
+    // so it never contains itself. Recursive calls go through
+    // the slot 0 of the function's own Environment instead.
+    std::vector<Value> captures;
+    captures.reserve(stmt.captures.size());
+    for (const Binding& capture : stmt.captures) {
+        captures.emplace_back(
+            get_environment(capture).get_at(capture.depth, capture.slot).decay()
+        );
+    }
 
-    // Add a ValueHandle of the function to the closure.
-    // The ValueHandle will properly decay
-    // in the Environmet::get() method.
-    fun_handle.unwrap_to<Function>().closure().define(
-        stmt.name.lexeme(), fun_handle
+    env_.define(
+        stmt.slot,
+        Function{ &stmt, std::move(captures) }
     );
-    // Beware: copying the Function into it's own closure
-    // will leak memory. Do not copy/decay it here.
-
+    return {};
 }
 
 
 
 
-void InterpretVisitor::operator()(const ReturnStmt& stmt) const {
-    // Walk up the call stack with exceptions.
-    // To be caught in the Function::operator()
-    throw evaluate(*stmt.expr);
+Completion InterpretVisitor::operator()(const ReturnStmt& stmt) const {
+    // Propagated up to the Function::operator()
+    // through the return values of the enclosing statements.
+    return Completion{ evaluate(*stmt.expr) };
 }
 
 
 
 
 
-void InterpretVisitor::operator()(const ImportStmt& stmt) const {
-    return;
+Completion InterpretVisitor::operator()(const ImportStmt& stmt) const {
+    return {};
 }
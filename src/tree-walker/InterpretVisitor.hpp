@@ -7,6 +7,7 @@
 class Interpreter;
 class Environment;
 class Value;
+struct Completion;
 
 
 class InterpretVisitor {
@@ -31,22 +32,23 @@ public:
 
     // Stmt visitor overloads
     // Note: the return types are different.
-
-    void operator()(const PrintStmt& stmt) const;
-    void operator()(const ExpressionStmt& stmt) const;
-    void operator()(const VarStmt& stmt) const;
-    void operator()(const BlockStmt& stmt) const;
-    void operator()(const IfStmt& stmt) const;
-    void operator()(const WhileStmt& stmt) const;
-    void operator()(const FunStmt& stmt) const;
-    void operator()(const ReturnStmt& stmt) const;
-    void operator()(const ImportStmt& stmt) const;
+    // See Completion.hpp.
+
+    Completion operator()(const PrintStmt& stmt) const;
+    Completion operator()(const ExpressionStmt& stmt) const;
+    Completion operator()(const VarStmt& stmt) const;
+    Completion operator()(const BlockStmt& stmt) const;
+    Completion operator()(const IfStmt& stmt) const;
+    Completion operator()(const WhileStmt& stmt) const;
+    Completion operator()(const FunStmt& stmt) const;
+    Completion operator()(const ReturnStmt& stmt) const;
+    Completion operator()(const ImportStmt& stmt) const;
 
 private:
     Value evaluate(const Expr& expr) const;
     Value evaluate_without_decay(const Expr& expr) const;
 
-    void execute(const Stmt& stmt) const;
+    Completion execute(const Stmt& stmt) const;
 
 
     static bool is_truthful(const Value& value);
@@ -62,6 +64,11 @@ private:
 
     void report_error_and_abort(InterpreterError::Type type, const Expr& expr, std::string_view details = "") const;
 
+    template<typename ExprT>
+    const Binding& get_binding(const ExprT& expr) const;
+
+    Environment& get_environment(const Binding& binding) const;
+
     template<typename CallableValue>
     CallableValue& get_invokable(Value& callee, std::vector<Value>& args, const CallExpr& expr) const;
 
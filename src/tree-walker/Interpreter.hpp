@@ -3,6 +3,7 @@
 #include "InterpreterError.hpp"
 #include "ErrorSender.hpp"
 #include "Environment.hpp"
+#include "Completion.hpp"
 #include "Expr.hpp"
 #include "Stmt.hpp"
 #include "Value.hpp"
@@ -29,6 +30,9 @@ public:
     {}
 
     bool interpret(std::span<const std::unique_ptr<Stmt>> statements) {
+        // Make room for the globals declared during the last resolve pass,
+        // so that no global is ever read out of bounds.
+        env_.resize(resolver_.num_global_slots());
         try {
             for (const auto& statement : statements) {
                 statement->accept(visitor_);
@@ -39,15 +43,21 @@ public:
         }
     }
 
-    bool interpret(std::span<const std::unique_ptr<Stmt>> statements, Environment& env) {
+    // Interprets the body of a function. Stops at the first
+    // 'return' statement and passes it's completion through.
+    Completion interpret(std::span<const std::unique_ptr<Stmt>> statements, Environment& env) {
         try {
             InterpretVisitor local_visitor{ *this, env };
             for (const auto& statement : statements) {
-                statement->accept(local_visitor);
+                if (Completion completion{ statement->accept(local_visitor) };
+                    completion.is_return())
+                {
+                    return completion;
+                }
             }
-            return true;
+            return {};
         } catch (InterpreterError::Type) {
-            return false;
+            return {};
         }
     }
 
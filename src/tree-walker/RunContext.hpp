@@ -6,6 +6,7 @@
 #include "Scanner.hpp"
 #include "Parser.hpp"
 #include "Interpreter.hpp"
+#include "FlatInterpreter.hpp"
 #include "CommonVisitors.hpp"
 #include "Resolver.hpp"
 #include "Builtins.hpp"
@@ -24,19 +25,27 @@ private:
 
     Frontend frontend_;
     Interpreter interpreter_;
+    // Only one of the interpreters is used for the whole run,
+    // the builtins are defined in it's global Environment.
+    FlatInterpreter flat_interpreter_;
+    bool flat_ast_;
 public:
     RunContext(
         ErrorReporter& err_reporter,
-        bool debug_scanner, bool debug_parser,
+        bool debug_scanner, bool debug_parser, bool flat_ast = false,
         std::optional<std::filesystem::path> filename = {}
     ) :
         ErrorSender{ err_reporter },
+        filename_{ std::move(filename) },
         frontend_{ err_reporter, { debug_scanner, debug_parser } },
         interpreter_{ err_reporter, frontend_.resolver() },
-        filename_{ std::move(filename) }
+        flat_interpreter_{ err_reporter, frontend_.resolver() },
+        flat_ast_{ flat_ast }
     {
         setup_builtins(
-            interpreter_.get_global_environment(),
+            flat_ast_ ?
+                flat_interpreter_.get_global_environment() :
+                interpreter_.get_global_environment(),
             frontend_.resolver()
         );
     }
@@ -79,7 +88,7 @@ public:
 
         std::cout << "> ";
         while (std::getline(std::cin, line)) {
-            run(line);
+            run(frontend().sources().add(std::move(line)));
             std::cout << "> ";
         }
         std::cout << std::endl;
@@ -89,7 +98,7 @@ public:
     void run_file() {
         // filename_ is guaranteed to have value if called from start_running()
         assert(filename_);
-        auto text = Importer::read_file(filename_.value());
+        auto text = frontend().sources().read(filename_.value());
         if (text) {
             // The data flow here is awkward, tbh
             run(text.value());
@@ -99,11 +108,14 @@ public:
     }
 
 
-    void run(const std::string& text) {
+    // The 'text' must be retained by the sources() of the Frontend.
+    void run(std::string_view text) {
 
         auto new_stmts = frontend().pass(text, filename_);
 
-        bool success = interpreter_.interpret(new_stmts);
+        bool success = flat_ast_ ?
+            flat_interpreter_.interpret(new_stmts) :
+            interpreter_.interpret(new_stmts);
 
         if (!success) {
             frontend().importer().undo_last_successful_pass();
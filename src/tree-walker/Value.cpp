@@ -4,6 +4,8 @@
 #include "Stmt.hpp"
 #include "ValueDecl.hpp"
 #include <memory>
+#include <utility>
+#include <vector>
 #include <cassert>
 
 
@@ -24,6 +26,19 @@ Value ValueHandle::decay() const noexcept {
 
 
 
+Function::Impl::Impl(const FunStmt* declaration, std::vector<Value> captures) :
+    closure_{ nullptr, std::move(captures) },
+    declaration_{ declaration }
+{}
+
+
+Function::Impl::Impl(const FunStmt* declaration, std::vector<Value> captures, FlatAST::Index flat_function) :
+    closure_{ nullptr, std::move(captures) },
+    declaration_{ declaration },
+    flat_function_{ flat_function }
+{}
+
+
 size_t Function::arity() const noexcept {
     assert(pimpl_->declaration_);
     return pimpl_->declaration_->parameters.size();
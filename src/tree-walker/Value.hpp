@@ -18,6 +18,7 @@
 #include <boost/unordered_map.hpp>
 #include <fmt/format.h>
 #include "Environment.hpp"
+#include "FlatAST.hpp"
 #include "ValueDecl.hpp"
 #include "VariantWrapper.hpp"
 
@@ -139,16 +140,21 @@ class Function {
 private:
     class Impl {
     private:
+        // Copies of the captured variables, see FunStmt::captures.
+        // Encloses the Environment of the function body,
+        // but has no enclosing Environment itself.
         Environment closure_;
         const FunStmt* declaration_;
+        // The body in the FlatAST, when interpreted from it.
+        FlatAST::Index flat_function_{ FlatAST::none };
         friend Function;
 
     public:
         Impl(const FunStmt* declaration) : declaration_{ declaration } {}
 
-        // Copy construct closure
-        Impl(const FunStmt* declaration, Environment closure) :
-            declaration_{ declaration }, closure_{ std::move(closure) } {}
+        Impl(const FunStmt* declaration, std::vector<Value> captures);
+
+        Impl(const FunStmt* declaration, std::vector<Value> captures, FlatAST::Index flat_function);
 
     }; // class Impl
 
@@ -158,7 +164,9 @@ private:
     // That leaks memory because the closure keeps the Impl alive.
 
 public:
-    template<typename ...Args>
+    // Constrained, so that the Function (and through it, the Value)
+    // does not pretend to be constructible from anything at all.
+    template<typename ...Args> requires std::constructible_from<Impl, Args...>
     Function(Args&&... args) :
         pimpl_{ std::make_shared<Impl>(std::forward<Args>(args)...) }
     {}
@@ -187,10 +195,15 @@ public:
 
     size_t arity() const noexcept;
 
-    Environment& closure() noexcept { return pimpl_->closure_; }
+    // The Environment that encloses the body of the function.
+    Environment* closure() noexcept {
+        return &pimpl_->closure_;
+    }
 
     const FunStmt* declaration() const noexcept { return pimpl_->declaration_; }
 
+    FlatAST::Index flat_function() const noexcept { return pimpl_->flat_function_; }
+
     bool operator==(const Function& other) const noexcept {
         return pimpl_.get() == other.pimpl_.get();
     }
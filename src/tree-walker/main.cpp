@@ -36,6 +36,7 @@ int main(int argc, const char* argv[]) {
         err_reporter,
         args.debug_scanner,
         args.debug_parser,
+        args.flat_ast,
         args.filename
     };
 
@@ -0,0 +1,76 @@
+#include <doctest/doctest.h>
+#include <iostream>
+#include <string>
+#include "CommonVisitors.hpp"
+#include "ErrorReporter.hpp"
+#include "Frontend.hpp"
+
+
+// Runs the whole frontend, the optimizer included,
+// and prints the resulting statements one per line.
+static std::string optimized(const std::string& text) {
+    StreamErrorReporter err{ std::cerr };
+    Frontend frontend{ err };
+    std::string result;
+    for (const auto& stmt : frontend.pass(text)) {
+        result += stmt->accept(ASTPrintVisitor{}) + '\n';
+    }
+    return result;
+}
+
+
+TEST_SUITE("ASTOptimizer") {
+
+TEST_CASE("arithmetic") {
+
+    CHECK(optimized("print 1 + 2 * 3;") == "print 7;\n");
+    CHECK(optimized("print (1 + 2) * 3;") == "print 9;\n");
+    CHECK(optimized("print -(2 - 5);") == "print 3;\n");
+    CHECK(optimized("print \"ab\" + \"cd\";") == "print \"abcd\";\n");
+
+}
+
+
+TEST_CASE("comparison and equality") {
+
+    CHECK(optimized("print 1 < 2;") == "print true;\n");
+    CHECK(optimized("print 2 >= 3;") == "print false;\n");
+    CHECK(optimized("print \"a\" == \"a\";") == "print true;\n");
+    CHECK(optimized("print nil != false;") == "print true;\n");
+    CHECK(optimized("print !nil;") == "print true;\n");
+
+}
+
+
+TEST_CASE("logical") {
+
+    CHECK(optimized("var a = 1; print nil or a;") == "var a = 1;\nprint a;\n");
+    CHECK(optimized("var a = 1; print false and a;") == "var a = 1;\nprint false;\n");
+    CHECK(optimized("var a = 1; print a and false;") == "var a = 1;\nprint (and a false);\n");
+
+}
+
+
+TEST_CASE("errors are left for runtime") {
+
+    CHECK(optimized("print -\"a\";") == "print (- \"a\");\n");
+    CHECK(optimized("print 1 + \"a\";") == "print (+ 1 \"a\");\n");
+
+}
+
+
+TEST_CASE("branches") {
+
+    CHECK(optimized("if (1 > 2) print 1; else print 2;") == "print 2;\n");
+    CHECK(optimized("if (true) print 1;") == "print 1;\n");
+    CHECK(optimized("if (nil) print 1;") == "{\n}\n");
+    CHECK(optimized("while (false) print 1;") == "{\n}\n");
+
+    CHECK(
+        optimized("var a = 1; if (a) print (a);") ==
+        "var a = 1;\nif (a) print a;  \n"
+    );
+
+}
+
+}
@@ -0,0 +1,57 @@
+#include <doctest/doctest.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CharScan.hpp"
+
+
+using char_scan::Isa;
+
+
+TEST_SUITE("CharScan") {
+
+TEST_CASE("every implementation agrees with the plain loops") {
+
+    // Runs of every length around the vector widths,
+    // stopped by each kind of character.
+    std::vector<std::string> texts;
+    for (size_t length : { 0, 1, 2, 15, 16, 17, 31, 32, 33, 47, 48, 64, 100 }) {
+        for (std::string_view stop : { "", "\n", "\"", "(", "\t", "a", "_", "0", " ", "\xC3\xA9" }) {
+            texts.push_back(std::string(length, ' ') + std::string(stop) + "tail");
+            texts.push_back(std::string(length, '\t') + " \r" + std::string(stop));
+            texts.push_back(std::string(length, 'x') + "Az_09" + std::string(stop));
+            texts.push_back(std::string(length, '/') + std::string(stop) + "\n");
+        }
+    }
+
+    auto scan_all = [&texts]() {
+        std::vector<std::vector<const char*>> results;
+        for (const std::string& text : texts) {
+            const char* first{ text.data() };
+            const char* last{ text.data() + text.size() };
+            results.push_back({
+                char_scan::skip_blanks(first, last),
+                char_scan::skip_identifier(first, last),
+                char_scan::find_line_end(first, last),
+                char_scan::find_quote_or_line_end(first, last)
+            });
+        }
+        return results;
+    };
+
+    Isa initial{ char_scan::isa() };
+
+    REQUIRE(char_scan::use_isa(Isa::scalar));
+    auto expected = scan_all();
+
+    for (Isa isa : { Isa::sse2, Isa::avx2 }) {
+        if (char_scan::use_isa(isa)) {
+            CHECK(scan_all() == expected);
+        }
+    }
+
+    char_scan::use_isa(initial);
+
+}
+
+}
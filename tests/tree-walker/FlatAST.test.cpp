@@ -0,0 +1,106 @@
+#include <doctest/doctest.h>
+#include <iostream>
+#include <string>
+#include <variant>
+#include "ErrorReporter.hpp"
+#include "FlatAST.hpp"
+#include "Frontend.hpp"
+
+
+using Kind = FlatAST::Kind;
+
+
+TEST_SUITE("FlatAST") {
+
+TEST_CASE("expressions") {
+
+    StreamErrorReporter err{ std::cerr };
+    Frontend frontend{ err, { false, false, false } };
+    FlatAST ast;
+
+    auto range = ast.append(frontend.pass("print (1 + 2) * -1;"));
+    REQUIRE(range.size == 1);
+
+    const auto& print = ast.node(ast.list(range)[0]);
+    CHECK(print.kind == Kind::print);
+
+    // The group is dropped, the children follow the parent.
+    const auto& star = ast.node(print.a);
+    CHECK(star.kind == Kind::binary);
+    CHECK(star.op == TokenType::star);
+
+    const auto& plus = ast.node(star.a);
+    CHECK(plus.kind == Kind::binary);
+    CHECK(plus.op == TokenType::plus);
+    CHECK(star.a < star.b);
+
+    const auto& minus = ast.node(star.b);
+    CHECK(minus.kind == Kind::unary);
+    CHECK(minus.op == TokenType::minus);
+
+    // 1 is interned once.
+    CHECK(ast.num_constants() == 2);
+    CHECK(ast.node(minus.a).a == ast.node(plus.a).a);
+    CHECK(std::get<Number>(ast.constant(ast.node(plus.b).a)) == 2.0);
+
+}
+
+
+TEST_CASE("statements") {
+
+    StreamErrorReporter err{ std::cerr };
+    Frontend frontend{ err, { false, false, false } };
+    FlatAST ast;
+
+    auto range = ast.append(frontend.pass(
+        "var a = 1; fun f(x) { return x; } { var b = a; f(b); }"
+    ));
+    REQUIRE(range.size == 3);
+    auto top = ast.list(range);
+
+    const auto& var = ast.node(top[0]);
+    CHECK(var.kind == Kind::var);
+    CHECK(ast.node(var.b).kind == Kind::literal);
+
+    const auto& fun = ast.node(top[1]);
+    REQUIRE(fun.kind == Kind::fun);
+    const auto& function = ast.function(fun.a);
+    CHECK(function.declaration->name.lexeme() == "f");
+    REQUIRE(function.size == 1);
+    CHECK(ast.node(ast.list(function.first, function.size)[0]).kind == Kind::ret);
+
+    const auto& block = ast.node(top[2]);
+    REQUIRE(block.kind == Kind::block);
+    REQUIRE(block.b == 2);
+    CHECK(block.c == 1);
+
+    const auto& call = ast.node(ast.node(ast.list(block.a, block.b)[1]).a);
+    REQUIRE(call.kind == Kind::call);
+    CHECK(call.c == 1);
+    const auto& arg = ast.node(ast.list(call.b, call.c)[0]);
+    CHECK(arg.kind == Kind::variable);
+    CHECK(arg.binding == Binding::Kind::local);
+    CHECK(ast.source(ast.list(call.b, call.c)[0]).is<VariableExpr>());
+
+}
+
+
+TEST_CASE("passes are appended") {
+
+    StreamErrorReporter err{ std::cerr };
+    Frontend frontend{ err, { false, false, false } };
+    FlatAST ast;
+
+    auto first = ast.append(frontend.pass("var a = \"s\";"));
+    auto num_nodes = ast.num_nodes();
+    auto second = ast.append(frontend.pass("print a; print \"s\";"));
+
+    CHECK(second.first == first.first + first.size);
+    CHECK(second.size == 2);
+    CHECK(ast.list(second)[0] >= num_nodes);
+    CHECK(ast.num_constants() == 1);
+    CHECK(ast.node(ast.node(ast.list(second)[0]).a).binding == Binding::Kind::global);
+
+}
+
+}
@@ -0,0 +1,116 @@
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ErrorReporter.hpp"
+#include "Importer.hpp"
+#include "Scanner.hpp"
+#include "SourceManager.hpp"
+#include "TokenStream.hpp"
+
+
+namespace {
+
+namespace fs = std::filesystem;
+
+void write_file(const fs::path& path, const std::string& text) {
+    std::ofstream fs{ path, std::ios::binary };
+    fs << text;
+}
+
+std::string import_of(const fs::path& path) {
+    return "import \"" + path.string() + "\";\n";
+}
+
+size_t count_lexeme(const TokenStream& tokens, std::string_view lexeme) {
+    return size_t(std::count_if(tokens.begin(), tokens.end(),
+        [lexeme](const Token& token) { return token.lexeme() == lexeme; }));
+}
+
+} // namespace
+
+
+TEST_SUITE("Importer") {
+
+TEST_CASE("same file through different paths") {
+
+    auto dir = fs::temp_directory_path() / "lox-importer-test";
+    fs::create_directories(dir);
+
+    // 'b' imports 'a' back, 'c' is reached through a symlink too.
+    write_file(dir / "a.lox", import_of(dir / "b.lox") + import_of(dir / "c.lox") + "var a;\n");
+    write_file(dir / "b.lox", import_of(dir / "a.lox") + import_of(dir / "." / "c.lox") + "var b;\n");
+    write_file(dir / "c.lox", "var c;\n");
+    fs::remove(dir / "c_link.lox");
+    fs::create_symlink(dir / "c.lox", dir / "c_link.lox");
+
+    StreamErrorReporter err{ std::cerr };
+    SourceManager sources;
+    Importer importer{ err, sources };
+    importer.mark_imported(dir / "a.lox");
+
+    Scanner scanner{ err };
+    auto text = sources.read(dir / "a.lox");
+    REQUIRE(text.has_value());
+    auto tokens = importer.resolve_imports(scanner.scan_tokens(text.value(), dir / "a.lox"));
+
+    REQUIRE(!importer.has_failed());
+    CHECK(count_lexeme(tokens, "a") == 1);
+    CHECK(count_lexeme(tokens, "b") == 1);
+    CHECK(count_lexeme(tokens, "c") == 1);
+    CHECK(importer.imported_files().size() == 3);
+
+    // Each import goes right after it's statement.
+    std::vector<std::string_view> names;
+    for (const Token& token : tokens) {
+        if (token.type() == TokenType::identifier) {
+            names.push_back(token.lexeme());
+        }
+    }
+    CHECK(names == std::vector<std::string_view>{ "c", "b", "a" });
+
+    // Imported already, through the other name.
+    auto again = importer.resolve_imports(Scanner{ err }.scan_tokens(sources.add(import_of(dir / "c_link.lox"))));
+    CHECK(!importer.has_failed());
+    CHECK(count_lexeme(again, "c") == 0);
+    CHECK(importer.imported_files().size() == 3);
+
+    fs::remove_all(dir);
+
+}
+
+
+TEST_CASE("failed and undone passes leave files importable") {
+
+    auto dir = fs::temp_directory_path() / "lox-importer-fail-test";
+    fs::create_directories(dir);
+    write_file(dir / "ok.lox", "var ok;\n");
+
+    StreamErrorReporter err{ std::cerr };
+    SourceManager sources;
+    Importer importer{ err, sources };
+
+    auto source = import_of(dir / "ok.lox") + import_of(dir / "missing.lox");
+    auto tokens = importer.resolve_imports(Scanner{ err }.scan_tokens(source));
+    CHECK(importer.has_failed());
+    CHECK(importer.imported_files().empty());
+
+    tokens = importer.resolve_imports(Scanner{ err }.scan_tokens(sources.add(import_of(dir / "ok.lox"))));
+    CHECK(!importer.has_failed());
+    CHECK(count_lexeme(tokens, "ok") == 1);
+
+    importer.undo_last_successful_pass();
+    importer.undo_last_successful_pass();
+    CHECK(importer.imported_files().empty());
+
+    tokens = importer.resolve_imports(Scanner{ err }.scan_tokens(sources.add(import_of(dir / "." / "ok.lox"))));
+    CHECK(count_lexeme(tokens, "ok") == 1);
+
+    fs::remove_all(dir);
+
+}
+
+}
@@ -84,4 +84,50 @@ TEST_CASE("multiline") {
 
 
 
+TEST_CASE("literals-and-locations") {
+
+    StreamErrorReporter err{ std::cerr };
+    Scanner s{ err };
+
+    std::string_view text{ "print \"lox\" + 2.5;\nprint nil or true;" };
+    auto tokens = s.scan_tokens(text);
+
+    REQUIRE(tokens.size() == 10);
+
+    CHECK(std::get<String>(tokens[1].literal()) == "lox");
+    CHECK(std::get<Number>(tokens[3].literal()) == 2.5);
+    CHECK(std::holds_alternative<Nil>(tokens[6].literal()));
+    CHECK(std::get<Boolean>(tokens[8].literal()) == true);
+    CHECK(!tokens[0].has_literal());
+
+    // The lexemes are not copied out of the text.
+    CHECK(tokens[0].lexeme().data() == text.data());
+    CHECK(tokens[5].lexeme().data() == text.data() + text.find('\n') + 1);
+    CHECK(tokens[0] == tokens[5]);
+
+    CHECK(tokens[5].line() == 2);
+    CHECK(tokens[5].column() == 6);
+    CHECK(!tokens[5].has_file());
+
+}
+
+
+
+TEST_CASE("keywords") {
+
+    for (auto type{ to_underlying(TokenType::kw_and) }; type <= to_underlying(TokenType::kw_import); ++type) {
+        CHECK(keyword_or_identifier(to_lexeme(TokenType(type))) == TokenType(type));
+    }
+
+    // Same length, first and last characters as the keywords.
+    for (std::string_view name : { "", "a", "ad", "aNd", "cls", "clas", "fan", "fur", "id", "oor",
+                                   "pint", "rerun", "sour", "tis", "tree", "vir", "whale", "impart",
+                                   "imports", "_var", "var_", "While" }) {
+        CHECK(keyword_or_identifier(name) == TokenType::identifier);
+    }
+
+}
+
+
+
 }
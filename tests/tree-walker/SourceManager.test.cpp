@@ -0,0 +1,52 @@
+#include <doctest/doctest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include "SourceManager.hpp"
+
+
+TEST_SUITE("SourceManager") {
+
+TEST_CASE("buffers stay in place") {
+
+    SourceManager sources;
+
+    std::string_view first{ sources.add("var a = 1;") };
+    const char* data{ first.data() };
+
+    // Short strings would move with the string itself.
+    for (int i{ 0 }; i < 100; ++i) {
+        sources.add(std::to_string(i));
+    }
+
+    CHECK(first.data() == data);
+    CHECK(first == "var a = 1;");
+    CHECK(sources.num_buffers() == 101);
+
+}
+
+
+TEST_CASE("read") {
+
+    auto path = std::filesystem::temp_directory_path() / "lox-source-manager-test.lox";
+    std::string text(100'000, 'x');
+    text += "\nprint \"end\";\n";
+    {
+        std::ofstream fs{ path, std::ios::binary };
+        fs << text;
+    }
+
+    SourceManager sources;
+    auto read = sources.read(path);
+    REQUIRE(read.has_value());
+    CHECK(read.value() == text);
+
+    std::filesystem::remove(path);
+    CHECK(!sources.read(path).has_value());
+    CHECK(!sources.read(std::filesystem::temp_directory_path()).has_value());
+    CHECK(sources.num_buffers() == 1);
+
+}
+
+}
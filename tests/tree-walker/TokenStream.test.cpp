@@ -0,0 +1,64 @@
+#include <doctest/doctest.h>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Scanner.hpp"
+#include "TokenStream.hpp"
+
+
+namespace {
+
+std::string join_lexemes(TokenStream::const_iterator first, TokenStream::const_iterator last) {
+    std::string result;
+    for (; first != last; ++first) {
+        result += first->lexeme();
+    }
+    return result;
+}
+
+} // namespace
+
+
+TEST_SUITE("TokenStream") {
+
+TEST_CASE("segments read as one range") {
+
+    StreamErrorReporter err{ std::cerr };
+
+    TokenStream stream;
+    auto outer = stream.add_file(Scanner{ err }.scan_tokens("a b c"));
+    auto inner = stream.add_file(Scanner{ err }.scan_tokens("x y"));
+
+    // Like "a b" importing "x y", followed by the rest of the outer file.
+    stream.add_segment(outer.first(2));
+    stream.add_segment(inner);
+    stream.add_segment(outer.subspan(2, 0));
+    stream.add_segment(outer.subspan(2));
+
+    CHECK(stream.num_segments() == 3);
+    CHECK(std::distance(stream.begin(), stream.end()) == 5);
+    CHECK(join_lexemes(stream.begin(), stream.end()) == "abxyc");
+    CHECK(stream.back().lexeme() == "c");
+
+    // Back across the segments, like the Parser does with peek_previous().
+    std::string backwards;
+    auto it = stream.end();
+    while (it != stream.begin()) {
+        --it;
+        backwards += it->lexeme();
+    }
+    CHECK(backwards == "cyxba");
+
+    Scanner::append_eof(stream);
+    CHECK(stream.back().type() == TokenType::eof);
+    CHECK(std::next(stream.begin(), 5)->type() == TokenType::eof);
+
+    TokenStream empty;
+    CHECK(empty.begin() == empty.end());
+
+}
+
+}